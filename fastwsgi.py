@@ -1,6 +1,12 @@
 import os
 import sys
+import time
+import mmap
+import struct
 import signal
+import select
+import subprocess
+import threading
 import importlib
 import click
 import _fastwsgi
@@ -25,28 +31,66 @@ class _Server():
         self.port = 5000
         self.backlog = 2048
         self.loglevel = LL_ERROR
+        self.log_async = 0              # 1 = log messages are written by background thread (dropped when queue is full)
         self.hook_sigint = 2            # 0 = ignore Ctrl-C; 1 = stop server on Ctrl-C; 2 = halt process on Ctrl-C
+        self.hook_sigusr2 = 0           # 0 = ignore SIGUSR2; 1 = on SIGUSR2 start new server generation and drain this one
+        self.listen_fd = None           # inherited listen socket (def value: env FASTWSGI_LISTEN_FD)
+        self.hook_sigterm = 0           # 0 = ignore SIGTERM; 1 = on SIGTERM finish active requests and exit
+        self.drain_timeout = None       # def value: 30 (seconds to finish active requests on SIGTERM/SIGUSR2)
         self.allow_keepalive = True
+        self.keep_alive_timeout = None  # def value: 0 = unlimited (idle timeout in seconds)
+        self.keep_alive_requests = 0    # max number of requests per connection (0 = unlimited)
+        self.header_timeout = None      # def value: 0 = unlimited (seconds to receive request headers)
+        self.body_timeout = None        # def value: 0 = unlimited (seconds to receive request body)
         self.add_header_date = True
         self.add_header_server = "FastWSGI/{}".format(__version__)
+        self.header_cache = 1           # 1 = reuse serialized headers when app passes status and headers with the same content
+        self.lazy_environ = 0           # 1 = environ is dict subclass that creates values of request headers on first access
+        self.access_log = None          # file name of access log ("-" = stdout; None = disabled)
         self.max_content_length = None  # def value: 999999999
         self.max_chunk_size = None      # def value: 256 KiB
         self.read_buffer_size = None    # def value: 64 KiB
+        self.read_buffer_hugepages = 0  # 1 = back the shared read buffer pool by huge pages (Linux only)
+        self.client_pool_size = None    # def value: 64 (number of recycled connection objects)
+        self.max_connections = 0        # 0 = unlimited; 1...N = accepting paused while N clients connected
+        self.overload_lag = 0           # 0 = disabled; 1...N = answer 503 without calling app while event loop lag above N ms
+        self.overload_retry_after = 1   # value of "Retry-After" header of 503 response (seconds)
         self.tcp_nodelay = 0            # 0 = Nagle's algo enabled; 1 = Nagle's algo disabled;
         self.tcp_keepalive = 0          # -1 = disabled; 0 = system default; 1...N = timeout in seconds
         self.tcp_send_buf_size = 0      # 0 = system default; 1...N = size in bytes
         self.tcp_recv_buf_size = 0      # 0 = system default; 1...N = size in bytes
+        self.tcp_defer_accept = 0       # 0 = disabled; 1...N = timeout in seconds (TCP_DEFER_ACCEPT, Linux only)
+        self.tcp_fastopen = 0           # 0 = disabled; 1...N = queue length of pending TFO requests
         self.nowait = 0
         self.num_workers = 1
+        self.num_threads = 1            # number of event loops (threads) into each worker process
         self.worker_list = [ ]
+        self.worker_respawn = True      # restart crashed workers
+        self.worker_timeout = 0         # 0 = disabled; 1...N = kill (SIGKILL) worker if any its event loop is blocked N seconds
+        self.heartbeat_interval = 1000  # worker heartbeat period in milliseconds
+        self.heartbeat_shm = None       # shared memory with heartbeat counters of workers
+        self.worker_index = -1
+        self.thread_index = 0           # index of event loop into worker process (set by thread_run)
+        self.cpu_affinity = 0           # 1 = pin workers to CPUs and steer connections by incoming CPU (Linux only)
+        self._reuseport_slots = [ ]     # worker indexes in order of their listen sockets into reuseport group
+        self._spawn_pending = { }       # read end of readiness pipe -> [ worker index, PID, deadline ]
+        self._upgrading = False         # new server generation already started
+        self._upgrade_ready = None      # read end of readiness pipe of new server generation
+        self._upgraded = False          # new server generation reported readiness
+        self._ready_fd = None           # write end of readiness pipe of parent (old generation or master)
+        self._draining = False          # workers are finishing active connections (no respawn)
         
-    def init(self, app, host = None, port = None, loglevel = None, workers = None):
+    def init(self, app, host = None, port = None, loglevel = None, workers = None, threads = None):
         self.app = app
+        ready_fd = os.environ.pop("FASTWSGI_READY_FD", None)
+        if ready_fd is not None:
+            self._ready_fd = int(ready_fd)  # this process is new server generation
         self.host = host if host else self.host
         self.port = port if port else self.port
         self.loglevel = loglevel if loglevel is not None else self.loglevel
         self.num_workers = workers if workers is not None else self.num_workers
-        if self.num_workers > 1:
+        self.num_threads = threads if threads is not None else self.num_threads
+        if self.num_workers > 1 or self.num_threads > 1:
             return 0
         return _fastwsgi.init_server(self)
 
@@ -56,11 +100,15 @@ class _Server():
 
     def run(self):
         if self.nowait:
-            if self.num_workers > 1:
+            if self.num_workers > 1 or self.num_threads > 1:
                 raise Exception('Incorrect server options')
+            self._notify_ready()
             return _fastwsgi.run_nowait(self)
         if self.num_workers > 1:
             return self.multi_run()
+        if self.num_threads > 1:
+            return self.thread_run()
+        self._notify_ready()
         ret = _fastwsgi.run_server(self)
         self.close()
         return ret
@@ -71,27 +119,316 @@ class _Server():
     def multi_run(self, num_workers = None):
         if num_workers is not None:
             self.num_workers = num_workers
-        for _ in range(self.num_workers):
-            pid = os.fork()
-            if pid > 0:
-                self.worker_list.append(pid)
-                print(f"Worker process added with PID: {pid}")
-                continue
-            try:
+        if self.host.startswith("unix:"):
+            raise Exception('Unix socket listener cannot be shared by worker processes')
+        if self.worker_timeout > 0:
+            # one heartbeat slot per event loop of each worker
+            self.heartbeat_shm = mmap.mmap(-1, 8 * self.num_workers * max(self.num_threads, 1))
+        self.worker_list = [ None ] * self.num_workers
+        self._worker_info = [ None ] * self.num_workers
+        if self.cpu_affinity and not hasattr(os, "sched_setaffinity"):
+            print("Option cpu_affinity not supported on this platform")
+            self.cpu_affinity = 0
+        if self.hook_sigusr2 and hasattr(signal, "SIGUSR2"):
+            signal.signal(signal.SIGUSR2, self._upgrade)
+        if self.hook_sigterm:
+            signal.signal(signal.SIGTERM, self._terminate)
+        for idx in range(self.num_workers):
+            self._spawn_worker(idx)
+            while self.cpu_affinity and self._spawn_pending:
+                self._wait_ready(0.5)  # listen sockets join reuseport group one by one
+        while self._spawn_pending:
+            self._wait_ready(0.5)
+        self._notify_ready()
+        try:
+            self._supervise()
+        except KeyboardInterrupt:
+            print("\n" + "Stopping all workers")
+            self._stop_workers(signal.SIGINT)
+        return 0
+
+    def _spawn_worker(self, idx):
+        # worker reports that its listen sockets are bound
+        ready_r, ready_w = os.pipe()
+        slot = len(self._reuseport_slots)
+        pid = os.fork()
+        if pid > 0:
+            self.worker_list[idx] = pid
+            # [ spawn time, last heartbeat values, times of last heartbeat change ] (per event loop)
+            now = time.monotonic()
+            self._worker_info[idx] = [ now, self._get_heartbeat(idx), [ now ] * max(self.num_threads, 1) ]
+            print(f"Worker process added with PID: {pid}")
+            os.close(ready_w)
+            self._spawn_pending[ready_r] = [ idx, pid, now + 5.0 ]  # see _wait_ready
+            return pid
+        self.worker_index = idx
+        if self.hook_sigusr2 and hasattr(signal, "SIGUSR2"):
+            signal.signal(signal.SIGUSR2, signal.SIG_IGN)  # handled by event loop of worker
+        if self.hook_sigterm:
+            signal.signal(signal.SIGTERM, signal.SIG_DFL)  # handled by event loop of worker
+        try:
+            os.close(ready_r)
+            for fd in self._spawn_pending:
+                os.close(fd)  # readiness pipes of other workers
+            self._spawn_pending = { }
+            if self._ready_fd is not None:
+                os.close(self._ready_fd)  # readiness of generation is reported by master
+            self._ready_fd = ready_w
+            if self.cpu_affinity:
+                os.sched_setaffinity(0, self._worker_cpus(slot))
+            if self.num_threads > 1:
+                self.thread_run()
+            else:
                 _fastwsgi.init_server(self)
+                self._notify_ready()
                 _fastwsgi.run_server(self)
-            except KeyboardInterrupt:
+        except KeyboardInterrupt:
+            pass
+        sys.exit(0)
+
+    def _worker_cpus(self, slot):
+        # BPF program of listen socket selects socket by: incoming_cpu % num_workers
+        cpus = { cpu for cpu in range(os.cpu_count()) if cpu % self.num_workers == slot }
+        return cpus if cpus else os.sched_getaffinity(0)
+
+    def _reuseport_release(self, idx):
+        # kernel moves the last socket of reuseport group into the vacant place
+        slots = self._reuseport_slots
+        if idx not in slots:
+            return
+        slot = slots.index(idx)
+        last = slots.pop()
+        if slot < len(slots):
+            slots[slot] = last
+            pid = self.worker_list[last]
+            if pid is not None:
+                try:
+                    os.sched_setaffinity(pid, self._worker_cpus(slot))
+                except OSError:
+                    pass
+
+    def _get_heartbeat(self, idx):
+        # counters of all event loops of worker
+        num = max(self.num_threads, 1)
+        if self.heartbeat_shm is None:
+            return [ 0 ] * num
+        return list(struct.unpack_from(f"{num}Q", self.heartbeat_shm, idx * num * 8))
+
+    def _wait_ready(self, timeout):
+        # waits for readiness reports of spawned workers (not longer than timeout)
+        fds = list(self._spawn_pending)
+        if not fds:
+            time.sleep(timeout)
+            return
+        ready, _, _ = select.select(fds, [ ], [ ], timeout)
+        for fd in ready:
+            idx, pid, _ = self._spawn_pending.pop(fd)
+            if os.read(fd, 1) and self.worker_list[idx] == pid:
+                if self.cpu_affinity and self.num_threads <= 1:
+                    self._reuseport_slots.append(idx)  # group index == slot
+            os.close(fd)
+        now = time.monotonic()
+        for fd, (idx, pid, deadline) in list(self._spawn_pending.items()):
+            if now < deadline:
+                continue
+            print(f"Worker with PID {pid} is not ready after 5 seconds. Killing it.")
+            del self._spawn_pending[fd]
+            os.close(fd)
+            try:
+                os.kill(pid, signal.SIGKILL)
+            except ProcessLookupError:
                 pass
-            sys.exit(0)
+
+    def _supervise(self):
+        while any(pid is not None for pid in self.worker_list):
+            self._wait_ready(0.5)
+            self._check_upgrade()
+            self._reap_workers()
+            now = time.monotonic()
+            for idx, pid in enumerate(self.worker_list):
+                info = self._worker_info[idx]
+                if pid is None:
+                    if self._draining:
+                        continue
+                    if self.cpu_affinity and self._spawn_pending:
+                        continue  # listen sockets join reuseport group one by one
+                    # a crash loop (ex. bind error) should not burn CPU by endless forking
+                    if info and now - info[0] >= 1.0:
+                        self._spawn_worker(idx)
+                    continue
+                if self.worker_timeout <= 0:
+                    continue
+                values = self._get_heartbeat(idx)
+                for loop, value in enumerate(values):
+                    if value != info[1][loop]:
+                        info[1][loop] = value
+                        info[2][loop] = now
+                stalled = [ loop for loop, ts in enumerate(info[2]) if now - ts > self.worker_timeout ]
+                if stalled:
+                    print(f"Worker with PID {pid} is not responding (loop {stalled[0]}). Killing it.")
+                    os.kill(pid, signal.SIGKILL)
+                    info[2] = [ now ] * len(info[2])
+
+    def _reap_workers(self):
+        while True:
+            try:
+                pid, status = os.waitpid(-1, os.WNOHANG)
+            except ChildProcessError:
+                return
+            if pid == 0:
+                return
+            if pid not in self.worker_list:
+                continue
+            idx = self.worker_list.index(pid)
+            self.worker_list[idx] = None
+            self._reuseport_release(idx)
+            crashed = os.WIFSIGNALED(status) or os.WEXITSTATUS(status) != 0
+            if crashed and self.worker_respawn and not self._draining:
+                print(f"Worker with PID {pid} died unexpectedly (status = {status}). Respawning.")
+            else:
+                self._worker_info[idx] = None  # worker stopped normally
+
+    def _spawn_generation(self, listen_fd = -1):
+        # called by C-module on SIGUSR2: start a copy of this program that takes over the listen socket
+        # returns descriptor that becomes readable when new generation is ready (or has died)
+        if self._upgrading:
+            if self._upgrade_ready is not None:
+                return os.dup(self._upgrade_ready)
+            if self._upgraded:
+                # readiness already reported to other event loop: descriptor readable at once
+                ready_r, ready_w = os.pipe()
+                os.write(ready_w, b"1")
+                os.close(ready_w)
+                return ready_r
+            return -1
+        env = os.environ.copy()
+        ready_r, ready_w = os.pipe()
+        env["FASTWSGI_READY_FD"] = str(ready_w)
+        pass_fds = ( ready_w, )
+        if listen_fd >= 0:
+            env["FASTWSGI_LISTEN_FD"] = str(listen_fd)
+            pass_fds += ( listen_fd, )
+        else:
+            env.pop("FASTWSGI_LISTEN_FD", None)  # new generation binds own SO_REUSEPORT sockets
+        argv = getattr(sys, "orig_argv", None) or [ sys.executable ] + sys.argv
+        try:
+            proc = subprocess.Popen(argv, env = env, pass_fds = pass_fds)
+        except OSError:
+            os.close(ready_r)
+            raise
+        finally:
+            os.close(ready_w)
+        print(f"New server generation started with PID: {proc.pid}")
+        self._upgrading = True
+        self._upgrade_ready = ready_r
+        return os.dup(ready_r)
+
+    def _upgrade_done(self, ready):
+        # new generation reported readiness (or exited before it)
+        if self._upgrade_ready is not None:
+            os.close(self._upgrade_ready)  # event loops poll own duplicates
+            self._upgrade_ready = None
+        if ready:
+            self._upgraded = True
+            return 0
+        if self._upgrading:
+            print("New server generation failed to start")
+            self._upgrading = False
+        return 0
+
+    def _notify_ready(self):
+        # report to parent (old generation or master) that listen sockets are bound
+        if self._ready_fd is None:
+            return
+        try:
+            os.write(self._ready_fd, b"1")
+        except OSError:
+            pass
+        os.close(self._ready_fd)
+        self._ready_fd = None
+
+    def _upgrade(self, signum, frame):
+        if self._draining or self._upgrading:
+            return
+        os.close(self._spawn_generation(-1))
+        # workers are drained by supervisor when new generation is ready (see _check_upgrade)
+
+    def _check_upgrade(self):
+        fd = self._upgrade_ready
+        if fd is None or self._draining:
+            return
+        ready, _, _ = select.select([ fd ], [ ], [ ], 0)
+        if not ready:
+            return
+        ok = bool(os.read(fd, 1))
+        self._upgrade_done(ok)
+        if ok:
+            self._drain_workers(signal.SIGUSR2)
+
+    def _terminate(self, signum, frame):
+        if self._draining:
+            return
+        self._drain_workers(signal.SIGTERM)
+
+    def _drain_workers(self, signum):
+        # workers finish active requests and exit (no respawn)
+        self._draining = True
+        print("Draining all workers")
+        for pid in self.worker_list:
+            if pid is not None:
+                try:
+                    os.kill(pid, signum)
+                except ProcessLookupError:
+                    pass
+
+    def _stop_workers(self, signum):
+        for pid in self.worker_list:
+            if pid is not None:
+                try:
+                    os.kill(pid, signum)
+                except ProcessLookupError:
+                    pass
+        for pid in self.worker_list:
+            if pid is not None:
+                try:
+                    os.waitpid(pid, 0)
+                except ChildProcessError:
+                    pass
+
+    def thread_run(self, num_threads = None):
+        if num_threads is not None:
+            self.num_threads = num_threads
+        thread_list = [ ]
+        for idx in range(self.num_threads):
+            self.thread_index = idx
+            # servers are inited one by one: the C-module shares constants between loops
+            inited = threading.Event()
+            status = { }
+            th = threading.Thread(target = self._thread_worker, args = (inited, status), daemon = True)
+            th.start()
+            inited.wait()
+            if status.get('error'):
+                raise status['error']
+            thread_list.append(th)
+        self._notify_ready()
         try:
-            for _ in range(self.num_workers):
-                os.wait()
+            for th in thread_list:
+                while th.is_alive():
+                    th.join(0.5)
         except KeyboardInterrupt:
-            print("\n" + "Stopping all workers")
-            for worker in self.worker_list:
-                os.kill(worker, signal.SIGINT)
+            print("\n" + "Stopping all threads")
         return 0
 
+    def _thread_worker(self, inited, status):
+        try:
+            _fastwsgi.init_server(self)
+        except Exception as e:
+            status['error'] = e
+            inited.set()
+            return
+        inited.set()
+        _fastwsgi.run_server(self)
+
 server = _Server()
 
 # -------------------------------------------------------------------------------------
@@ -122,7 +459,7 @@ def import_from_string(import_str):
 
 @click.command()
 @click.version_option(version=get_distribution("fastwsgi").version, message="%(version)s")
-@click.option("--host", help="Host the socket is bound to.", type=str, default=server.host, show_default=True)
+@click.option("--host", help="Host the socket is bound to (unix:/path for Unix domain socket).", type=str, default=server.host, show_default=True)
 @click.option("-p", "--port", help="Port the socket is bound to.", type=int, default=server.port, show_default=True)
 @click.option("-l", "--loglevel", help="Logging level.", type=int, default=server.loglevel, show_default=True)
 @click.argument(
@@ -146,7 +483,18 @@ def run_from_cli(host, port, wsgi_app_import_string, loglevel):
 
 # -------------------------------------------------------------------------------------
 
-def run(app = None, host = None, port = None, loglevel = None, workers = None, wsgi_app = None):
+def get_stats():
+    # counters of servers running into current process (each worker process has its own)
+    return _fastwsgi.get_stats()
+
+def get_latency():
+    # histograms "parse", "app" and "ttlb" (time to last byte) in microseconds
+    return _fastwsgi.get_latency()
+
+def reset_latency():
+    return _fastwsgi.reset_latency()
+
+def run(app = None, host = None, port = None, loglevel = None, workers = None, wsgi_app = None, threads = None):
     if app and wsgi_app:
         raise Exception("It is not allowed to specify several applications at once.")
     if app is None:
@@ -154,7 +502,8 @@ def run(app = None, host = None, port = None, loglevel = None, workers = None, w
     if app is None:
         raise Exception("app not specify.")
     print("FastWSGI server running on PID:", os.getpid())
-    server.init(app, host, port, loglevel, workers)
+    server.init(app, host, port, loglevel, workers, threads)
     addon = " multiple workers" if server.num_workers > 1 else ""
+    addon += " multiple threads" if server.num_threads > 1 else ""
     print(f"FastWSGI server{addon} listening at http://{server.host}:{server.port}")
     server.run()
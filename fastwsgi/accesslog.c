@@ -0,0 +1,217 @@
+#include "accesslog.h"
+#include "ring.h"
+#include "llhttp.h"
+#include <time.h>
+
+#define ALOG_NUM_SLOTS    8192   // 4 MiB
+#define ALOG_BATCH_SIZE   (64*1024)
+
+typedef struct {
+    int64_t time;        // unix time in microseconds
+    int64_t bytes;       // size of response body
+    uint64_t duration;   // from first byte of request to last byte of response (us)
+    uint16_t status;
+    uint8_t method;      // llhttp_method_t
+    uint8_t http_minor;
+    uint16_t addr_len;
+    uint16_t path_len;
+    char data[1];        // remote_addr + path
+} alog_record_t;
+
+static struct {
+    int refs;            // number of servers that use access log (changed under lock)
+    uv_mutex_t lock;     // serializes open and close from event loop threads
+    char path[1024];     // file name of opened access log
+    ring_t ring;
+    uv_thread_t thread;
+    uv_file fd;
+    char buf[ALOG_BATCH_SIZE];
+    int64_t time_sec;    // cached time string
+    char time_str[32];
+} g_alog;
+
+static
+void access_log_flush(int size)
+{
+    char * data = g_alog.buf;
+    while (size > 0) {
+        uv_fs_t req;
+        uv_buf_t buf = uv_buf_init(data, (unsigned int)size);
+        int rc = uv_fs_write(NULL, &req, g_alog.fd, &buf, 1, -1, NULL);
+        uv_fs_req_cleanup(&req);
+        if (rc <= 0)
+            break;  // records are lost
+        data += rc;
+        size -= rc;
+    }
+}
+
+static
+int access_log_format(char * out, int maxlen, const alog_record_t * rec)
+{
+    int64_t sec = rec->time / 1000000;
+    if (sec != g_alog.time_sec) {
+        time_t t = (time_t)sec;
+        struct tm tm;
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        strftime(g_alog.time_str, sizeof(g_alog.time_str), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+        g_alog.time_sec = sec;
+    }
+    const char * addr = (rec->addr_len > 0) ? rec->data : "-";
+    int addr_len = (rec->addr_len > 0) ? rec->addr_len : 1;
+    const char * method = llhttp_method_name((enum llhttp_method)rec->method);
+    int len = snprintf(out, maxlen, "%.*s - - [%s] \"%s %.*s HTTP/1.%d\" %d %lld %d.%06d\n",
+        addr_len, addr, g_alog.time_str, method,
+        (int)rec->path_len, rec->data + rec->addr_len, (int)rec->http_minor,
+        (int)rec->status, (long long)rec->bytes,
+        (int)(rec->duration / 1000000), (int)(rec->duration % 1000000));
+    return (len < 0) ? 0 : _min(len, maxlen - 1);
+}
+
+static
+void access_log_writer(void * arg)
+{
+    int size = 0;
+    while (1) {
+        int stop = (int)RING_LOAD(&g_alog.ring.stop);
+        ring_slot_t * slot;
+        while ((slot = ring_peek(&g_alog.ring)) != NULL) {
+            if (size > ALOG_BATCH_SIZE - RING_SLOT_SIZE - 128) {
+                access_log_flush(size);
+                size = 0;
+            }
+            size += access_log_format(g_alog.buf + size, ALOG_BATCH_SIZE - size, (alog_record_t *)slot->data);
+            ring_release(&g_alog.ring, slot);
+        }
+        if (size > 0) {
+            access_log_flush(size);
+            size = 0;
+        }
+        if (stop)
+            break;
+        ring_wait(&g_alog.ring);  // woken by producer or by access_log_close
+    }
+}
+
+static uv_once_t g_alog_once = UV_ONCE_INIT;
+
+static
+void access_log_init_once(void)
+{
+    uv_mutex_init(&g_alog.lock);
+}
+
+static
+void access_log_stop(void)
+{
+    if (g_alog.refs == 1) {
+        ring_stop(&g_alog.ring);
+        uv_thread_join(&g_alog.thread);  // all records are written
+        ring_free(&g_alog.ring);
+        CNT_SET(&g_alog.refs, 0);
+    }
+    if (g_alog.fd > 2) {
+        uv_fs_t req;
+        uv_fs_close(NULL, &req, g_alog.fd, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+    g_alog.fd = 0;
+    g_alog.path[0] = 0;
+}
+
+static
+int access_log_start(const char * path)
+{
+    if (strcmp(path, "-") == 0) {
+        g_alog.fd = 1;  // stdout
+    } else {
+        uv_fs_t req;
+        int fd = uv_fs_open(NULL, &req, path, UV_FS_O_WRONLY | UV_FS_O_CREAT | UV_FS_O_APPEND, 0644, NULL);
+        uv_fs_req_cleanup(&req);
+        if (fd < 0) {
+            LOGe("%s: cannot open file \"%s\": %s", __func__, path, uv_strerror(fd));
+            return -1;
+        }
+        g_alog.fd = fd;
+    }
+    if (ring_init(&g_alog.ring, ALOG_NUM_SLOTS) != 0) {
+        access_log_stop();
+        return -2;
+    }
+    g_alog.time_sec = 0;
+    if (uv_thread_create(&g_alog.thread, access_log_writer, NULL) != 0) {
+        LOGe("%s: cannot create writer thread", __func__);
+        ring_free(&g_alog.ring);
+        access_log_stop();
+        return -3;
+    }
+    snprintf(g_alog.path, sizeof(g_alog.path), "%s", path);
+    CNT_SET(&g_alog.refs, 1);
+    LOGn("%s: access log \"%s\"", __func__, path);
+    return 0;
+}
+
+int access_log_open(const char * path)
+{
+    int hr = 0;
+    uv_once(&g_alog_once, access_log_init_once);
+    uv_mutex_lock(&g_alog.lock);
+    if (g_alog.refs > 0) {
+        if (strcmp(path, g_alog.path) != 0) {
+            LOGe("%s: access log \"%s\" already opened by process (\"%s\" rejected)", __func__, g_alog.path, path);
+            hr = -4;
+        } else {
+            CNT_SET(&g_alog.refs, g_alog.refs + 1);  // next event loop of process
+        }
+    } else {
+        hr = access_log_start(path);
+    }
+    uv_mutex_unlock(&g_alog.lock);
+    return hr;
+}
+
+void access_log_close(void)
+{
+    uv_once(&g_alog_once, access_log_init_once);
+    uv_mutex_lock(&g_alog.lock);
+    if (g_alog.refs > 1) {
+        CNT_SET(&g_alog.refs, g_alog.refs - 1);
+    } else {
+        access_log_stop();
+    }
+    uv_mutex_unlock(&g_alog.lock);
+}
+
+void access_log_add(int status, int method, int http_minor, int64_t bytes, uint64_t duration,
+                    const char * remote_addr, const char * path, int path_len)
+{
+    ring_slot_t * slot = ring_reserve(&g_alog.ring);
+    if (!slot)
+        return;  // ring is full: record dropped
+    alog_record_t * rec = (alog_record_t *)slot->data;
+    uv_timeval64_t tv;
+    uv_gettimeofday(&tv);
+    rec->time = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    rec->bytes = bytes;
+    rec->duration = duration;
+    rec->status = (uint16_t)status;
+    rec->method = (uint8_t)method;
+    rec->http_minor = (uint8_t)http_minor;
+    const int max_len = (int)(sizeof(slot->data) - offsetof(alog_record_t, data));
+    int addr_len = remote_addr ? (int)strlen(remote_addr) : 0;
+    rec->addr_len = (uint16_t)_min(addr_len, 64);
+    memcpy(rec->data, remote_addr, rec->addr_len);
+    rec->path_len = (uint16_t)_min(path_len, max_len - rec->addr_len);
+    memcpy(rec->data + rec->addr_len, path, rec->path_len);
+    slot->len = (uint32_t)(offsetof(alog_record_t, data) + rec->addr_len + rec->path_len);
+    ring_publish(&g_alog.ring, slot);
+}
+
+uint64_t access_log_drops(void)
+{
+    return (CNT_LOAD(&g_alog.refs) > 0) ? RING_LOAD(&g_alog.ring.drops) : 0;
+}
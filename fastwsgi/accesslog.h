@@ -0,0 +1,16 @@
+#ifndef FASTWSGI_ACCESSLOG_H_
+#define FASTWSGI_ACCESSLOG_H_
+
+#include "common.h"
+
+// Access log shared by all event loops of process. Loop threads only copy a binary record
+// into lock-free ring, formatting and writing to file is done by background thread.
+// All event loops of process share one file: opening of another path is rejected.
+
+int access_log_open(const char * path);
+void access_log_close(void);
+void access_log_add(int status, int method, int http_minor, int64_t bytes, uint64_t duration,
+                    const char * remote_addr, const char * path, int path_len);
+uint64_t access_log_drops(void);
+
+#endif
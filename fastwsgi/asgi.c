@@ -298,6 +298,7 @@ int asgi_build_response(client_t * client)
     int status = asgi->send.status;
     PyObject * start_response = asgi->send.start_response;
 
+    latency_app_end(client);  // app time: from call of app to "http.response.start"
     int flags = (client->request.keep_alive) ? RF_SET_KEEP_ALIVE : 0;
     int len = build_response(client, flags | RF_HEADERS_ASGI, status, start_response, NULL, -1);
     if (len <= 0) {
@@ -0,0 +1,98 @@
+#include "bufpool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#define BUFPOOL_SLAB_SIZE    (2*1024*1024)
+#define BUFPOOL_BLOCK_ALIGN  64
+
+int bufpool_init(bufpool_t * pool, size_t block_size, int huge_pages)
+{
+    memset(pool, 0, sizeof(bufpool_t));
+    pool->block_size = block_size;
+    pool->block_step = (block_size + BUFPOOL_BLOCK_ALIGN - 1) & ~(size_t)(BUFPOOL_BLOCK_ALIGN - 1);
+    size_t need_size = BUFPOOL_BLOCK_ALIGN + pool->block_step;
+    // slab size is a multiple of huge page size
+    pool->slab_size = (need_size + BUFPOOL_SLAB_SIZE - 1) & ~(size_t)(BUFPOOL_SLAB_SIZE - 1);
+    pool->huge_pages = huge_pages;
+    return 0;
+}
+
+static
+bufpool_slab_t * bufpool_slab_create(bufpool_t * pool)
+{
+    bufpool_slab_t * slab = NULL;
+#ifdef __linux__
+    if (pool->huge_pages) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        void * ptr = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED) {
+            // no reserved huge pages; fallback to transparent huge pages
+            ptr = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (ptr == MAP_FAILED)
+                return NULL;
+            madvise(ptr, pool->slab_size, MADV_HUGEPAGE);
+        }
+        slab = (bufpool_slab_t *)ptr;
+        slab->mmaped = 1;
+    }
+#endif
+    if (!slab) {
+        slab = (bufpool_slab_t *)malloc(pool->slab_size);
+        if (!slab)
+            return NULL;
+        slab->mmaped = 0;
+    }
+    slab->size = pool->slab_size;
+    return slab;
+}
+
+static
+void bufpool_slab_destroy(bufpool_slab_t * slab)
+{
+#ifdef __linux__
+    if (slab->mmaped) {
+        munmap(slab, slab->size);
+        return;
+    }
+#endif
+    free(slab);
+}
+
+void * bufpool_alloc_slab(bufpool_t * pool)
+{
+    bufpool_slab_t * slab = bufpool_slab_create(pool);
+    if (!slab) {
+        LOGc("%s: cannot allocate slab (size = %d)", __func__, (int)pool->slab_size);
+        return NULL;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->num_slabs++;
+    char * ptr = (char *)slab + BUFPOOL_BLOCK_ALIGN;
+    char * end = (char *)slab + slab->size;
+    for (; ptr + pool->block_step <= end; ptr += pool->block_step) {
+        bufpool_put(pool, ptr);
+        pool->num_blocks++;
+    }
+    LOGd("%s: slab %p added (blocks = %d/%d)", __func__, slab, pool->num_free, pool->num_blocks);
+    return pool->free_head;
+}
+
+void bufpool_free(bufpool_t * pool)
+{
+    LOGn_IF(pool->num_slabs, "%s: slabs = %d, blocks = %d, free = %d", __func__,
+        pool->num_slabs, pool->num_blocks, pool->num_free);
+    bufpool_slab_t * slab = pool->slabs;
+    while (slab) {
+        bufpool_slab_t * next = slab->next;
+        bufpool_slab_destroy(slab);
+        slab = next;
+    }
+    pool->slabs = NULL;
+    pool->free_head = NULL;
+    pool->num_blocks = 0;
+    pool->num_free = 0;
+    pool->num_slabs = 0;
+}
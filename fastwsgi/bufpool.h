@@ -0,0 +1,55 @@
+#ifndef FASTWSGI_BUFPOOL_H_
+#define FASTWSGI_BUFPOOL_H_
+
+#include "common.h"
+
+// Pool of equal-sized buffers carved from large slabs.
+// Used by one event loop only (no locking).
+
+typedef struct bufpool_slab_s {
+    struct bufpool_slab_s * next;
+    size_t size;         // full size of slab memory (including this header)
+    int mmaped;          // 1 = allocated by mmap
+} bufpool_slab_t;
+
+typedef struct {
+    size_t block_size;   // usable size of one block
+    size_t block_step;   // block_size aligned to cache line
+    size_t slab_size;
+    int huge_pages;      // 1 = try to back slabs by huge pages
+    bufpool_slab_t * slabs;
+    void * free_head;    // free-list of vacant blocks
+    int num_blocks;      // total number of blocks into all slabs
+    int num_free;        // number of vacant blocks
+    int num_slabs;
+} bufpool_t;
+
+int bufpool_init(bufpool_t * pool, size_t block_size, int huge_pages);
+void bufpool_free(bufpool_t * pool);
+void * bufpool_alloc_slab(bufpool_t * pool);
+
+INLINE
+static
+void * bufpool_get(bufpool_t * pool)
+{
+    void * block = pool->free_head;
+    if (!block) {
+        block = bufpool_alloc_slab(pool);
+        if (!block)
+            return NULL;
+    }
+    pool->free_head = *(void **)block;
+    pool->num_free--;
+    return block;
+}
+
+INLINE
+static
+void bufpool_put(bufpool_t * pool, void * block)
+{
+    *(void **)block = pool->free_head;
+    pool->free_head = block;
+    pool->num_free++;
+}
+
+#endif
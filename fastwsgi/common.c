@@ -72,9 +72,9 @@ const char * get_obj_attr_str(PyObject * obj, const char * name)
 static const char weekDays[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 static const char monthList[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 
-time_t g_actual_time = 0;
-char g_actual_asctime[32] = { 0 };
-int g_actual_asctime_len = 0;
+static THREAD_LOCAL time_t g_actual_time = 0;
+static THREAD_LOCAL char g_actual_asctime[32] = { 0 };
+static THREAD_LOCAL int g_actual_asctime_len = 0;
 
 int get_asctime(char ** asc_time)
 {
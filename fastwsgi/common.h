@@ -20,12 +20,37 @@
 # define INLINE inline
 #endif
 
+#if defined(_MSC_VER)
+# define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+# define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+# define THREAD_LOCAL _Thread_local
+#endif
+
 #define _max(a,b) (((a) > (b)) ? (a) : (b))
 #define _min(a,b) (((a) < (b)) ? (a) : (b))
 
 #define FIN_IF(_cond_,_code_) do { if ((_cond_)) { hr = _code_; goto fin; } } while(0)
 #define FIN(_code_)           do { hr = _code_; goto fin; } while(0)
 
+// Counters with single writer (own event loop) that are read from other threads (see get_stats).
+// Writer does not need locked instructions, atomic load/store only prevents torn values.
+#if defined(_MSC_VER)
+#define CNT_LOAD(_ptr_)            (*(_ptr_))  // event loop threads not supported on Windows
+#define CNT_SET(_ptr_, _val_)      (*(_ptr_) = (_val_))
+#define CNT_LOAD_ACQ(_ptr_)        (*(_ptr_))
+#define CNT_SET_REL(_ptr_, _val_)  (*(_ptr_) = (_val_))
+#else
+#define CNT_LOAD(_ptr_)            __atomic_load_n((_ptr_), __ATOMIC_RELAXED)
+#define CNT_SET(_ptr_, _val_)      __atomic_store_n((_ptr_), (_val_), __ATOMIC_RELAXED)
+#define CNT_LOAD_ACQ(_ptr_)        __atomic_load_n((_ptr_), __ATOMIC_ACQUIRE)
+#define CNT_SET_REL(_ptr_, _val_)  __atomic_store_n((_ptr_), (_val_), __ATOMIC_RELEASE)
+#endif
+#define CNT_ADD(_ptr_, _val_)      CNT_SET((_ptr_), CNT_LOAD(_ptr_) + (_val_))
+#define CNT_INC(_ptr_)             CNT_ADD((_ptr_), 1)
+#define CNT_DEC(_ptr_)             CNT_ADD((_ptr_), -1)
+
 typedef union {
     struct sockaddr_storage storage;
     struct sockaddr addr; 
@@ -34,8 +59,8 @@ typedef union {
 } sockaddr_t;
 
 
-// forced use this only for alpha version!
-#ifndef FASTWSGI_DEBUG
+// forced use this only for alpha version! (release build: FASTWSGI_BUILD=release python setup.py build)
+#if !defined(FASTWSGI_DEBUG) && !defined(FASTWSGI_RELEASE)
 #define FASTWSGI_DEBUG
 #endif
 
@@ -1,7 +1,132 @@
+#include "common.h"
 #include "constants.h"
 
 cvar_t g_cv;
 
+// Canonical spelling of well-known request headers (ASGI names reused only on exact match)
+static const char * g_header_names[HN__MAX] = {
+    [HN_CONTENT_LENGTH] = "Content-Length",
+    [HN_CONTENT_TYPE] = "Content-Type",
+    [HN_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [HN_EXPECT] = "Expect",
+    [HN_HOST] = "Host",
+    [HN_USER_AGENT] = "User-Agent",
+    [HN_ACCEPT] = "Accept",
+    [HN_ACCEPT_ENCODING] = "Accept-Encoding",
+    [HN_ACCEPT_LANGUAGE] = "Accept-Language",
+    [HN_ACCEPT_CHARSET] = "Accept-Charset",
+    [HN_CONNECTION] = "Connection",
+    [HN_KEEP_ALIVE] = "Keep-Alive",
+    [HN_CACHE_CONTROL] = "Cache-Control",
+    [HN_PRAGMA] = "Pragma",
+    [HN_COOKIE] = "Cookie",
+    [HN_REFERER] = "Referer",
+    [HN_ORIGIN] = "Origin",
+    [HN_AUTHORIZATION] = "Authorization",
+    [HN_PROXY_AUTHORIZATION] = "Proxy-Authorization",
+    [HN_UPGRADE] = "Upgrade",
+    [HN_UPGRADE_INSECURE_REQUESTS] = "Upgrade-Insecure-Requests",
+    [HN_VIA] = "Via",
+    [HN_FORWARDED] = "Forwarded",
+    [HN_FROM] = "From",
+    [HN_DATE] = "Date",
+    [HN_DNT] = "DNT",
+    [HN_TE] = "TE",
+    [HN_TRAILER] = "Trailer",
+    [HN_MAX_FORWARDS] = "Max-Forwards",
+    [HN_CONTENT_ENCODING] = "Content-Encoding",
+    [HN_CONTENT_MD5] = "Content-MD5",
+    [HN_CONTENT_RANGE] = "Content-Range",
+    [HN_RANGE] = "Range",
+    [HN_IF_MATCH] = "If-Match",
+    [HN_IF_NONE_MATCH] = "If-None-Match",
+    [HN_IF_MODIFIED_SINCE] = "If-Modified-Since",
+    [HN_IF_UNMODIFIED_SINCE] = "If-Unmodified-Since",
+    [HN_IF_RANGE] = "If-Range",
+    [HN_X_FORWARDED_FOR] = "X-Forwarded-For",
+    [HN_X_FORWARDED_HOST] = "X-Forwarded-Host",
+    [HN_X_FORWARDED_PROTO] = "X-Forwarded-Proto",
+    [HN_X_FORWARDED_PORT] = "X-Forwarded-Port",
+    [HN_X_REAL_IP] = "X-Real-IP",
+    [HN_X_REQUEST_ID] = "X-Request-ID",
+    [HN_X_REQUESTED_WITH] = "X-Requested-With",
+    [HN_X_CORRELATION_ID] = "X-Correlation-ID",
+    [HN_X_CSRF_TOKEN] = "X-CSRF-Token",
+    [HN_X_AMZN_TRACE_ID] = "X-Amzn-Trace-Id",
+    [HN_TRACEPARENT] = "Traceparent",
+    [HN_TRACESTATE] = "Tracestate",
+    [HN_SEC_FETCH_SITE] = "Sec-Fetch-Site",
+    [HN_SEC_FETCH_MODE] = "Sec-Fetch-Mode",
+    [HN_SEC_FETCH_DEST] = "Sec-Fetch-Dest",
+    [HN_SEC_FETCH_USER] = "Sec-Fetch-User",
+    [HN_SEC_CH_UA] = "sec-ch-ua",
+    [HN_SEC_CH_UA_MOBILE] = "sec-ch-ua-mobile",
+    [HN_SEC_CH_UA_PLATFORM] = "sec-ch-ua-platform",
+    [HN_SEC_WEBSOCKET_KEY] = "Sec-WebSocket-Key",
+    [HN_SEC_WEBSOCKET_VERSION] = "Sec-WebSocket-Version",
+    [HN_SEC_WEBSOCKET_EXTENSIONS] = "Sec-WebSocket-Extensions",
+    [HN_SEC_WEBSOCKET_PROTOCOL] = "Sec-WebSocket-Protocol",
+    [HN_ACCESS_CONTROL_REQUEST_METHOD] = "Access-Control-Request-Method",
+    [HN_ACCESS_CONTROL_REQUEST_HEADERS] = "Access-Control-Request-Headers",
+    [HN_PRIORITY] = "Priority",
+    [HN_PURPOSE] = "Purpose",
+};
+
+// Parameter of hash function selected to avoid collisions of well-known headers
+#define HN_HASH_MULT  8655
+
+INLINE
+static unsigned int hn_char(const char c)
+{
+    return (c == '_') ? '-' : (unsigned char)c | 0x20;  // "USER_AGENT" == "User-Agent"
+}
+
+INLINE
+static unsigned int hn_hash(const char * name, size_t len)
+{
+    uint32_t h = 0;
+    for (size_t i = 0; i < len; i++)
+        h = h * HN_HASH_MULT + hn_char(name[i]);
+
+    return (h ^ (h >> 15)) & (HN_HASH_SIZE - 1);
+}
+
+int find_header_name(const char * name, size_t len)
+{
+    int hn = g_cv.header_slot[hn_hash(name, len)];
+    if (hn == HN_UNKNOWN)
+        return HN_UNKNOWN;
+    const char * hname = g_header_names[hn];
+    for (size_t i = 0; i < len; i++) {
+        if (hname[i] == 0 || hn_char(name[i]) != hn_char(hname[i]))
+            return HN_UNKNOWN;
+    }
+    return (hname[len] == 0) ? hn : HN_UNKNOWN;
+}
+
+static
+void init_header_names()
+{
+    char key[128];
+    for (int hn = HN_UNKNOWN + 1; hn < HN__MAX; hn++) {
+        const char * name = g_header_names[hn];
+        size_t len = strlen(name);
+        size_t prefix_len = (hn == HN_CONTENT_LENGTH || hn == HN_CONTENT_TYPE) ? 0 : 5;
+        memcpy(key, "HTTP_", prefix_len);
+        for (size_t i = 0; i <= len; i++)
+            key[prefix_len + i] = (name[i] == '-') ? '_' : toupper(name[i]);
+
+        g_cv.header_key[hn] = PyUnicode_InternFromString(key);
+        g_cv.header_name[hn] = PyBytes_FromStringAndSize(name, len);
+        unsigned int slot = hn_hash(name, len);
+        if (g_cv.header_slot[slot] != HN_UNKNOWN) {
+            LOGc("%s: hash collision of headers \"%s\" and \"%s\"", __func__, name, g_header_names[g_cv.header_slot[slot]]);
+            continue;  // header will be processed as unknown
+        }
+        g_cv.header_slot[slot] = (unsigned char)hn;
+    }
+}
+
 static int g_cv_inited = 0;
 
 void init_constants()
@@ -28,6 +153,7 @@ void init_constants()
     g_cv.wsgi_multithread = PyUnicode_FromString("wsgi.multithread");
     g_cv.wsgi_multiprocess = PyUnicode_FromString("wsgi.multiprocess");
     g_cv.wsgi_input = PyUnicode_FromString("wsgi.input");
+    g_cv.wsgi_file_wrapper = PyUnicode_FromString("wsgi.file_wrapper");
     g_cv.wsgi_ver_1_0 = PyTuple_Pack(2, PyLong_FromLong(1), PyLong_FromLong(0));
 
     g_cv.http_scheme = PyUnicode_FromString("http");
@@ -38,6 +164,7 @@ void init_constants()
     g_cv.server_port = PyUnicode_FromString("5000");
     g_cv.empty_string = PyUnicode_FromString("");
     g_cv.empty_bytes = PyBytes_FromString("");
+    g_cv.empty_tuple = PyTuple_New(0);
 
     g_cv.module_io = PyImport_ImportModule("io");
     g_cv.BytesIO = PyUnicode_FromString("BytesIO");
@@ -47,6 +174,7 @@ void init_constants()
     g_cv.truncate = PyUnicode_FromString("truncate");
     g_cv.seek = PyUnicode_FromString("seek");
     g_cv.tell = PyUnicode_FromString("tell");
+    g_cv.fileno = PyUnicode_FromString("fileno");
     g_cv.buffer_size = PyUnicode_FromString("buffer_size");
     g_cv.getvalue = PyUnicode_FromString("getvalue");
     g_cv.getbuffer = PyUnicode_FromString("getbuffer");
@@ -92,4 +220,6 @@ void init_constants()
 
     g_cv.http_delim = PyBytes_FromString("\r\n");
     g_cv.footer_last_chunk = PyBytes_FromString("\r\n0\r\n\r\n");
+
+    init_header_names();
 }
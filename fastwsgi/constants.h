@@ -3,6 +3,79 @@
 
 #include <Python.h>
 
+// Well-known request headers (index into g_cv.header_key / g_cv.header_name)
+typedef enum {
+    HN_UNKNOWN = 0,
+    HN_CONTENT_LENGTH,
+    HN_CONTENT_TYPE,
+    HN_TRANSFER_ENCODING,
+    HN_EXPECT,
+    HN_HOST,
+    HN_USER_AGENT,
+    HN_ACCEPT,
+    HN_ACCEPT_ENCODING,
+    HN_ACCEPT_LANGUAGE,
+    HN_ACCEPT_CHARSET,
+    HN_CONNECTION,
+    HN_KEEP_ALIVE,
+    HN_CACHE_CONTROL,
+    HN_PRAGMA,
+    HN_COOKIE,
+    HN_REFERER,
+    HN_ORIGIN,
+    HN_AUTHORIZATION,
+    HN_PROXY_AUTHORIZATION,
+    HN_UPGRADE,
+    HN_UPGRADE_INSECURE_REQUESTS,
+    HN_VIA,
+    HN_FORWARDED,
+    HN_FROM,
+    HN_DATE,
+    HN_DNT,
+    HN_TE,
+    HN_TRAILER,
+    HN_MAX_FORWARDS,
+    HN_CONTENT_ENCODING,
+    HN_CONTENT_MD5,
+    HN_CONTENT_RANGE,
+    HN_RANGE,
+    HN_IF_MATCH,
+    HN_IF_NONE_MATCH,
+    HN_IF_MODIFIED_SINCE,
+    HN_IF_UNMODIFIED_SINCE,
+    HN_IF_RANGE,
+    HN_X_FORWARDED_FOR,
+    HN_X_FORWARDED_HOST,
+    HN_X_FORWARDED_PROTO,
+    HN_X_FORWARDED_PORT,
+    HN_X_REAL_IP,
+    HN_X_REQUEST_ID,
+    HN_X_REQUESTED_WITH,
+    HN_X_CORRELATION_ID,
+    HN_X_CSRF_TOKEN,
+    HN_X_AMZN_TRACE_ID,
+    HN_TRACEPARENT,
+    HN_TRACESTATE,
+    HN_SEC_FETCH_SITE,
+    HN_SEC_FETCH_MODE,
+    HN_SEC_FETCH_DEST,
+    HN_SEC_FETCH_USER,
+    HN_SEC_CH_UA,
+    HN_SEC_CH_UA_MOBILE,
+    HN_SEC_CH_UA_PLATFORM,
+    HN_SEC_WEBSOCKET_KEY,
+    HN_SEC_WEBSOCKET_VERSION,
+    HN_SEC_WEBSOCKET_EXTENSIONS,
+    HN_SEC_WEBSOCKET_PROTOCOL,
+    HN_ACCESS_CONTROL_REQUEST_METHOD,
+    HN_ACCESS_CONTROL_REQUEST_HEADERS,
+    HN_PRIORITY,
+    HN_PURPOSE,
+    HN__MAX
+} header_name_t;
+
+#define HN_HASH_SIZE  256   // size of hash table of well-known headers (see find_header_name)
+
 typedef struct {
     PyObject* REQUEST_METHOD;
     PyObject* SCRIPT_NAME;
@@ -22,6 +95,7 @@ typedef struct {
     PyObject* wsgi_multithread;
     PyObject* wsgi_multiprocess;
     PyObject* wsgi_input;
+    PyObject* wsgi_file_wrapper;
     PyObject* wsgi_ver_1_0;  // PyTuple(1, 0)
 
     PyObject* http_scheme;
@@ -32,6 +106,7 @@ typedef struct {
     PyObject* server_port;
     PyObject* empty_string;
     PyObject* empty_bytes;  // b""
+    PyObject* empty_tuple;  // ()
 
     PyObject* module_io;
     PyObject* BytesIO;
@@ -41,6 +116,7 @@ typedef struct {
     PyObject* truncate;
     PyObject* seek;
     PyObject* tell;
+    PyObject* fileno;
     PyObject* buffer_size;
     PyObject* getvalue;
     PyObject* getbuffer;  // "getbuffer"
@@ -87,10 +163,17 @@ typedef struct {
 
     PyObject* http_delim;  // b"\r\n"
     PyObject* footer_last_chunk;  // b"\r\n0\r\n\r\n"
+
+    PyObject* header_key[HN__MAX];  // interned WSGI environ keys ("HTTP_USER_AGENT", "CONTENT_TYPE", ...)
+    PyObject* header_name[HN__MAX];  // ASGI header names (bytes "User-Agent", ...)
+    unsigned char header_slot[HN_HASH_SIZE];  // hash of name -> header_name_t
 } cvar_t;
 
 extern cvar_t g_cv;
 
 void init_constants();
 
+// Returns header_name_t for "User-Agent" or "USER_AGENT" (HN_UNKNOWN if not well-known)
+int find_header_name(const char * name, size_t len);
+
 #endif
@@ -0,0 +1,382 @@
+#include "environ.h"
+#include "constants.h"
+
+#define EI_RESOLVED  0x100  // item already placed into dict (or dropped)
+
+typedef struct {
+    int size;      // full size of record (aligned)
+    int flags;
+    int klen;
+    int vlen;
+    // key + '\0' + value + '\0'
+} environ_item_t;
+
+#define EI_KEY(_item_)  ((char *)((_item_) + 1))
+#define EI_VAL(_item_)  (EI_KEY(_item_) + (_item_)->klen + 1)
+
+#define ENVIRON_FOREACH(_env_, _item_) \
+    for (environ_item_t * _item_ = (environ_item_t *)(_env_)->items.data; \
+         (char *)_item_ < (_env_)->items.data + (_env_)->items.size; \
+         _item_ = (environ_item_t *)((char *)_item_ + _item_->size))
+
+
+#define ENVIRON_SPARE_BUFS   16
+#define ENVIRON_BUF_SIZE     1024
+#define ENVIRON_BUF_MAX      (16*1024)  // larger buffers are not reused
+
+// item buffers of released environs (access serialized by GIL)
+static struct {
+    int count;
+    xbuf_t bufs[ENVIRON_SPARE_BUFS];
+} g_spare;
+
+PyObject * Environ_New(PyObject * base_dict)
+{
+    // dict_new + merge: skips call of type with parsing of args into dict_init
+    PyObject * self = PyDict_Type.tp_new(&Environ_Type, g_cv.empty_tuple, NULL);
+    if (self && PyDict_Merge(self, base_dict, 1) < 0)
+        Py_CLEAR(self);
+    return self;
+}
+
+int Environ_AddItem(PyObject * self, const char * key, size_t klen, const char * value, size_t vlen, int flags)
+{
+    Environ * env = (Environ *)self;
+    size_t size = sizeof(environ_item_t) + klen + 1 + vlen + 1;
+    size = (size + 3) & ~(size_t)3;
+    if (env->items.capacity == 0) {
+        if (g_spare.count > 0)
+            env->items = g_spare.bufs[--g_spare.count];
+        else
+            xbuf_expand(&env->items, _max(size, ENVIRON_BUF_SIZE));
+    }
+    environ_item_t * item = (environ_item_t *)xbuf_expand(&env->items, size);
+    if (!item)
+        return -1;
+    item->size = (int)size;
+    item->flags = flags;
+    item->klen = (int)klen;
+    item->vlen = (int)vlen;
+    memcpy(EI_KEY(item), key, klen);
+    EI_KEY(item)[klen] = 0;
+    memcpy(EI_VAL(item), value, vlen);
+    EI_VAL(item)[vlen] = 0;
+    env->items.size += (int)size;
+    env->lazy++;
+    return 0;
+}
+
+static
+PyObject * environ_item_value(environ_item_t * item)
+{
+    if (item->flags & EI_LATIN1)
+        return PyUnicode_DecodeLatin1(EI_VAL(item), item->vlen, NULL);
+
+    return PyUnicode_FromStringAndSize(EI_VAL(item), item->vlen);  // as UTF-8
+}
+
+static
+void environ_release(Environ * env)
+{
+    xbuf_t * buf = &env->items;
+    if (buf->data && buf->capacity <= ENVIRON_BUF_MAX && g_spare.count < ENVIRON_SPARE_BUFS) {
+        xbuf_reset(buf);
+        g_spare.bufs[g_spare.count++] = *buf;
+        memset(buf, 0, sizeof(xbuf_t));
+    } else {
+        xbuf_free(buf);
+    }
+    env->lazy = 0;
+}
+
+// Place raw item with specified key into dict (if it exists)
+static
+int environ_resolve(Environ * env, PyObject * key)
+{
+    if (env->lazy <= 0 || !PyUnicode_Check(key))
+        return 0;
+
+    Py_ssize_t klen = 0;
+    const char * kstr = PyUnicode_AsUTF8AndSize(key, &klen);
+    if (!kstr) {
+        PyErr_Clear();
+        return 0;
+    }
+    environ_item_t * found = NULL;
+    ENVIRON_FOREACH(env, item) {
+        if (item->flags & EI_RESOLVED || item->klen != (int)klen)
+            continue;
+        if (memcmp(EI_KEY(item), kstr, klen) == 0)
+            found = item;  // the last header with the same name wins
+    }
+    if (!found)
+        return 0;
+
+    int hr = 0;
+    PyObject * val = environ_item_value(found);
+    if (val) {
+        hr = PyDict_SetItem((PyObject *)env, key, val);
+        Py_DECREF(val);
+    } else {
+        PyErr_Clear();  // value cannot be decoded: item dropped
+    }
+    ENVIRON_FOREACH(env, item) {
+        if (item->flags & EI_RESOLVED || item->klen != (int)klen)
+            continue;
+        if (memcmp(EI_KEY(item), kstr, klen) == 0) {
+            item->flags |= EI_RESOLVED;
+            env->lazy--;
+        }
+    }
+    if (env->lazy <= 0)
+        environ_release(env);
+
+    return hr;
+}
+
+int Environ_Materialize(PyObject * self)
+{
+    Environ * env = (Environ *)self;
+    if (env->lazy <= 0)
+        return 0;
+
+    int hr = 0;
+    ENVIRON_FOREACH(env, item) {
+        if (item->flags & EI_RESOLVED)
+            continue;
+        item->flags |= EI_RESOLVED;
+        int hname = item->flags >> 16;
+        PyObject * key = NULL;
+        if (hname > HN_UNKNOWN && hname < HN__MAX) {
+            key = g_cv.header_key[hname];
+            Py_INCREF(key);
+        } else {
+            key = PyUnicode_FromStringAndSize(EI_KEY(item), item->klen);
+        }
+        PyObject * val = (key) ? environ_item_value(item) : NULL;
+        if (key && val) {
+            hr = PyDict_SetItem(self, key, val);
+        } else {
+            PyErr_Clear();  // key or value cannot be decoded: item dropped
+        }
+        Py_XDECREF(key);
+        Py_XDECREF(val);
+        if (hr)
+            break;
+    }
+    environ_release(env);
+    return hr;
+}
+
+#define ENVIRON_RESOLVE(_self_, _key_, _ret_) \
+    do { if (environ_resolve((Environ *)(_self_), (_key_)) < 0) return (_ret_); } while(0)
+
+#define ENVIRON_MATERIALIZE(_obj_, _ret_) \
+    do { if (Environ_CheckExact(_obj_) && Environ_Materialize(_obj_) < 0) return (_ret_); } while(0)
+
+// ---------------- slots --------------------------------------------------------
+
+static
+PyObject * Environ_Subscript(PyObject * self, PyObject * key)
+{
+    ENVIRON_RESOLVE(self, key, NULL);
+    return PyDict_Type.tp_as_mapping->mp_subscript(self, key);
+}
+
+static
+int Environ_AssSubscript(PyObject * self, PyObject * key, PyObject * value)
+{
+    ENVIRON_RESOLVE(self, key, -1);
+    return PyDict_Type.tp_as_mapping->mp_ass_subscript(self, key, value);
+}
+
+static
+Py_ssize_t Environ_Length(PyObject * self)
+{
+    ENVIRON_MATERIALIZE(self, -1);
+    return PyDict_Type.tp_as_mapping->mp_length(self);
+}
+
+static
+int Environ_Contains(PyObject * self, PyObject * key)
+{
+    ENVIRON_RESOLVE(self, key, -1);
+    return PyDict_Type.tp_as_sequence->sq_contains(self, key);
+}
+
+static
+PyObject * Environ_Iter(PyObject * self)
+{
+    ENVIRON_MATERIALIZE(self, NULL);
+    return PyDict_Type.tp_iter(self);
+}
+
+static
+PyObject * Environ_Repr(PyObject * self)
+{
+    ENVIRON_MATERIALIZE(self, NULL);
+    return PyDict_Type.tp_repr(self);
+}
+
+static
+PyObject * Environ_RichCompare(PyObject * self, PyObject * other, int op)
+{
+    ENVIRON_MATERIALIZE(self, NULL);
+    ENVIRON_MATERIALIZE(other, NULL);
+    return PyDict_Type.tp_richcompare(self, other, op);
+}
+
+static
+PyObject * environ_binary_op(PyObject * self, PyObject * other, int inplace)
+{
+    ENVIRON_MATERIALIZE(self, NULL);
+    ENVIRON_MATERIALIZE(other, NULL);
+    PyNumberMethods * nm = PyDict_Type.tp_as_number;
+    binaryfunc func = (!nm) ? NULL : (inplace) ? nm->nb_inplace_or : nm->nb_or;
+    if (!func)
+        Py_RETURN_NOTIMPLEMENTED;  // Python < 3.9
+    return func(self, other);
+}
+
+static
+PyObject * Environ_Or(PyObject * self, PyObject * other)
+{
+    return environ_binary_op(self, other, 0);
+}
+
+static
+PyObject * Environ_InplaceOr(PyObject * self, PyObject * other)
+{
+    return environ_binary_op(self, other, 1);
+}
+
+static
+void Environ_Dealloc(PyObject * self)
+{
+    environ_release((Environ *)self);
+    PyDict_Type.tp_dealloc(self);
+}
+
+// ---------------- methods ------------------------------------------------------
+
+static
+PyObject * Environ_Get(PyObject * self, PyObject * args)
+{
+    PyObject * key;
+    PyObject * def = Py_None;
+    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &def))
+        return NULL;
+
+    ENVIRON_RESOLVE(self, key, NULL);
+    PyObject * val = PyDict_GetItemWithError(self, key);
+    if (!val) {
+        if (PyErr_Occurred())
+            return NULL;
+        val = def;
+    }
+    Py_INCREF(val);
+    return val;
+}
+
+// Call method of dict after resolving of key (first arg) or all items
+static
+PyObject * environ_call_base(PyObject * self, const char * name, int by_key, PyObject * args, PyObject * kwargs)
+{
+    Py_ssize_t argc = PyTuple_GET_SIZE(args);
+    if (by_key && argc > 0) {
+        ENVIRON_RESOLVE(self, PyTuple_GET_ITEM(args, 0), NULL);
+    } else {
+        ENVIRON_MATERIALIZE(self, NULL);
+    }
+    PyObject * method = PyObject_GetAttrString((PyObject *)&PyDict_Type, name);
+    if (!method)
+        return NULL;
+
+    PyObject * result = NULL;
+    PyObject * margs = PyTuple_New(argc + 1);
+    if (margs) {
+        Py_INCREF(self);
+        PyTuple_SET_ITEM(margs, 0, self);
+        for (Py_ssize_t i = 0; i < argc; i++) {
+            PyObject * arg = PyTuple_GET_ITEM(args, i);
+            Py_INCREF(arg);
+            PyTuple_SET_ITEM(margs, i + 1, arg);
+        }
+        result = PyObject_Call(method, margs, kwargs);
+        Py_DECREF(margs);
+    }
+    Py_DECREF(method);
+    return result;
+}
+
+#define ENVIRON_METHOD(_name_, _by_key_) \
+    static PyObject * Environ_m_##_name_(PyObject * self, PyObject * args, PyObject * kwargs) { \
+        return environ_call_base(self, #_name_, _by_key_, args, kwargs); \
+    }
+
+ENVIRON_METHOD(pop, 1)
+ENVIRON_METHOD(setdefault, 1)
+ENVIRON_METHOD(keys, 0)
+ENVIRON_METHOD(items, 0)
+ENVIRON_METHOD(values, 0)
+ENVIRON_METHOD(update, 0)
+ENVIRON_METHOD(popitem, 0)
+ENVIRON_METHOD(clear, 0)
+ENVIRON_METHOD(copy, 0)
+ENVIRON_METHOD(__reversed__, 0)
+
+#define ENVIRON_METHOD_DEF(_name_) \
+    {#_name_, (PyCFunction)(void(*)(void))Environ_m_##_name_, METH_VARARGS | METH_KEYWORDS, NULL}
+
+static PyMethodDef Environ_Methods[] = {
+    {"get", (PyCFunction)Environ_Get, METH_VARARGS, NULL},
+    ENVIRON_METHOD_DEF(pop),
+    ENVIRON_METHOD_DEF(setdefault),
+    ENVIRON_METHOD_DEF(keys),
+    ENVIRON_METHOD_DEF(items),
+    ENVIRON_METHOD_DEF(values),
+    ENVIRON_METHOD_DEF(update),
+    ENVIRON_METHOD_DEF(popitem),
+    ENVIRON_METHOD_DEF(clear),
+    ENVIRON_METHOD_DEF(copy),
+    ENVIRON_METHOD_DEF(__reversed__),
+    {NULL}
+};
+
+static PyMappingMethods Environ_AsMapping = {
+    .mp_length        = Environ_Length,
+    .mp_subscript     = Environ_Subscript,
+    .mp_ass_subscript = Environ_AssSubscript,
+};
+
+static PySequenceMethods Environ_AsSequence = {
+    .sq_contains = Environ_Contains,
+};
+
+static PyNumberMethods Environ_AsNumber = {
+    .nb_or         = Environ_Or,
+    .nb_inplace_or = Environ_InplaceOr,
+};
+
+PyTypeObject Environ_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "fastwsgi.Environ",
+    .tp_basicsize   = sizeof(Environ),
+    .tp_itemsize    = 0,
+    .tp_dealloc     = (destructor) Environ_Dealloc,
+    .tp_repr        = Environ_Repr,
+    .tp_as_number   = &Environ_AsNumber,
+    .tp_as_sequence = &Environ_AsSequence,
+    .tp_as_mapping  = &Environ_AsMapping,
+    .tp_hash        = PyObject_HashNotImplemented,
+    .tp_flags       = Py_TPFLAGS_DEFAULT,
+    .tp_richcompare = Environ_RichCompare,
+    .tp_iter        = Environ_Iter,
+    .tp_methods     = Environ_Methods,
+};
+
+void Environ_Init(void)
+{
+    Environ_Type.tp_base = &PyDict_Type;
+    PyType_Ready(&Environ_Type);
+}
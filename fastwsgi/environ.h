@@ -0,0 +1,34 @@
+#ifndef FASTWSGI_ENVIRON_H_
+#define FASTWSGI_ENVIRON_H_
+
+#include "common.h"
+#include "xbuf.h"
+
+// WSGI environ with lazy creation of values: request headers are stored as raw
+// strings and converted to PyUnicode only on first access by key.
+// Any operation that requires all items (iteration, len, repr, copy, etc)
+// converts all remaining raw items into regular dict items.
+
+typedef struct {
+    PyDictObject dict;
+    xbuf_t items;      // records of raw items (environ_item_t + key + value)
+    int lazy;          // number of raw items not yet placed into dict
+} Environ;
+
+extern PyTypeObject Environ_Type;
+
+#define Environ_CheckExact(object) ((object)->ob_type == &Environ_Type)
+
+#define EI_LATIN1    0x01  // value decoded as Latin-1 (PATH_INFO, QUERY_STRING)
+#define EI_HNAME(_hn_)  ((_hn_) << 16)  // key is well-known header (see header_name_t)
+
+void Environ_Init(void);
+
+PyObject * Environ_New(PyObject * base_dict);
+
+int Environ_AddItem(PyObject * self, const char * key, size_t klen, const char * value, size_t vlen, int flags);
+
+// Place all raw items into dict (returns 0 on success)
+int Environ_Materialize(PyObject * self);
+
+#endif
@@ -7,6 +7,9 @@ static PyMethodDef FastWsgiFunctions[] = {
     { "run_server", run_server, METH_O, "" },
     { "run_nowait", run_nowait, METH_O, "" },
     { "close_server", close_server, METH_O, "" },
+    { "get_stats", get_stats, METH_NOARGS, "" },
+    { "get_latency", get_latency, METH_NOARGS, "" },
+    { "reset_latency", reset_latency, METH_NOARGS, "" },
     { NULL, NULL, 0, NULL}
 };
 
@@ -1,20 +1,26 @@
 #include "filewrapper.h"
+#include "constants.h"
+#include <sys/stat.h>
 
 // Ref FileWrapper: https://github.com/python/cpython/blob/main/Lib/wsgiref/util.py#L11
 
 PyObject* FileWrapper_New(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = { "filelike", "blksize", NULL };
     PyObject* filelike;
     PyObject* blksize = NULL;
 
-    if (!PyArg_ParseTuple(args, "OO", &filelike, &blksize))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &filelike, &blksize))
         return NULL;
 
     FileWrapper* wrapper = PyObject_NEW(FileWrapper, type);
+    if (!wrapper)
+        return NULL;
     wrapper->filelike = filelike;
-    wrapper->blksize = blksize;
+    wrapper->blksize = (blksize) ? blksize : PyLong_FromLong(8192);
 
     Py_INCREF(filelike);
-    Py_XINCREF(blksize);
+    if (blksize)
+        Py_INCREF(blksize);
 
     return (PyObject*)wrapper;
 }
@@ -25,45 +31,77 @@ PyObject* FileWrapper_Iter(PyObject* self) {
 }
 
 PyObject* FileWrapper_Next(PyObject* self) {
-    PyObject* read = PyUnicode_FromString("read");
     FileWrapper* wrapper = (FileWrapper*)self;
-    return PyObject_CallMethodObjArgs(wrapper->filelike, read, wrapper->blksize, NULL);
+    PyObject* data = PyObject_CallMethodObjArgs(wrapper->filelike, g_cv.read, wrapper->blksize, NULL);
+    if (data && PyBytes_Check(data) && PyBytes_GET_SIZE(data) == 0) {
+        Py_DECREF(data);
+        return NULL;  // end of file: StopIteration
+    }
+    return data;
 }
 
-PyObject* FileWrapper_Close(PyObject* self) {
+PyObject* FileWrapper_Close(PyObject* self, PyObject* Py_UNUSED(args)) {
     FileWrapper* wrapper = (FileWrapper*)self;
-    PyObject* close = PyUnicode_FromString("close");
-    if (PyObject_HasAttr(wrapper->filelike, close))
-        return PyObject_CallMethodObjArgs(wrapper->filelike, close, NULL);
+    if (PyObject_HasAttr(wrapper->filelike, g_cv.close))
+        return PyObject_CallMethodObjArgs(wrapper->filelike, g_cv.close, NULL);
 
     Py_RETURN_NONE;
 }
 
-void FileWrapper_Clear(PyObject* self) {
+void FileWrapper_Dealloc(PyObject* self) {
     FileWrapper* wrapper = (FileWrapper*)self;
-    Py_DECREF(wrapper->filelike);
-    Py_XDECREF(wrapper->blksize);
-    PyObject_FREE(self);
-    free(wrapper);
+    Py_CLEAR(wrapper->filelike);
+    Py_CLEAR(wrapper->blksize);
+    PyObject_Del(self);
 }
 
-PyTypeObject FileWrapper_Type = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "FileWrapper",
-    sizeof(FileWrapper),
-    0,
-    (destructor)FileWrapper_Clear,
-};
+int FileWrapper_GetFile(PyObject* self, int* fd, int64_t* offset, int64_t* size) {
+    FileWrapper* wrapper = (FileWrapper*)self;
+    int hr = 0;
+    PyObject* res = PyObject_CallMethodObjArgs(wrapper->filelike, g_cv.fileno, NULL);
+    FIN_IF(!res, -1);  // not a real file (io.BytesIO, etc)
+    long fileno = PyLong_AsLong(res);
+    Py_DECREF(res);
+    FIN_IF(fileno < 0, -2);
+
+    struct stat st;
+    FIN_IF(fstat((int)fileno, &st) != 0, -3);
+    FIN_IF(!S_ISREG(st.st_mode), -4);
+
+    // data is transmitted from the current position of file object
+    res = PyObject_CallMethodObjArgs(wrapper->filelike, g_cv.tell, NULL);
+    FIN_IF(!res, -5);
+    long long pos = PyLong_AsLongLong(res);
+    Py_DECREF(res);
+    FIN_IF(pos < 0, -6);
 
-static PyMethodDef Methods[] = {
+    *fd = (int)fileno;
+    *offset = (int64_t)pos;
+    *size = (pos < (long long)st.st_size) ? (int64_t)st.st_size - pos : 0;
+fin:
+    if (hr)
+        PyErr_Clear();
+    return hr;
+}
+
+static PyMethodDef FileWrapper_Methods[] = {
     {"close", (PyCFunction)FileWrapper_Close, METH_NOARGS, NULL},
     {NULL}
 };
 
+PyTypeObject FileWrapper_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "fastwsgi.FileWrapper",
+    .tp_basicsize = sizeof(FileWrapper),
+    .tp_itemsize  = 0,
+    .tp_dealloc   = (destructor) FileWrapper_Dealloc,
+    .tp_flags     = Py_TPFLAGS_DEFAULT,
+    .tp_iter      = FileWrapper_Iter,
+    .tp_iternext  = FileWrapper_Next,
+    .tp_methods   = FileWrapper_Methods,
+    .tp_new       = FileWrapper_New,
+};
+
 void FileWrapper_Init(void) {
-    FileWrapper_Type.tp_new = FileWrapper_New;
-    FileWrapper_Type.tp_iter = FileWrapper_Iter;
-    FileWrapper_Type.tp_flags |= Py_TPFLAGS_DEFAULT;
-    FileWrapper_Type.tp_iternext = FileWrapper_Next;
-    FileWrapper_Type.tp_methods = Methods;
-}
\ No newline at end of file
+    PyType_Ready(&FileWrapper_Type);
+}
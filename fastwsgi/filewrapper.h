@@ -1,7 +1,7 @@
 #ifndef FASTWSGI_FILEWRAPPER_H_
 #define FASTWSGI_FILEWRAPPER_H_
 
-#include <Python.h>
+#include "common.h"
 
 typedef struct {
     PyObject ob_base;
@@ -9,10 +9,13 @@ typedef struct {
     PyObject* blksize;
 } FileWrapper;
 
-PyTypeObject FileWrapper_Type;
+extern PyTypeObject FileWrapper_Type;
 
 #define FileWrapper_CheckExact(object) ((object)->ob_type == &FileWrapper_Type)
 
 void FileWrapper_Init(void);
 
+// Get descriptor of regular file wrapped by object (returns 0 on success)
+int FileWrapper_GetFile(PyObject* self, int* fd, int64_t* offset, int64_t* size);
+
 #endif
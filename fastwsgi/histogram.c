@@ -0,0 +1,44 @@
+#include "histogram.h"
+
+void hist_reset(hist_t * h)
+{
+    memset(h, 0, sizeof(hist_t));
+}
+
+void hist_merge(hist_t * dst, const hist_t * src)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += CNT_LOAD(&src->buckets[i]);
+    dst->count += CNT_LOAD(&src->count);
+    dst->sum += CNT_LOAD(&src->sum);
+    uint64_t max = CNT_LOAD(&src->max);
+    if (max > dst->max)
+        dst->max = max;
+}
+
+// highest value that falls into bucket
+uint64_t hist_bucket_value(int index)
+{
+    if (index < HIST_SUB)
+        return (uint64_t)index;
+    int exp = index / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index % HIST_SUB);
+    uint64_t width = (uint64_t)1 << (exp - HIST_SUB_BITS);
+    return ((HIST_SUB + sub) << (exp - HIST_SUB_BITS)) + width - 1;
+}
+
+uint64_t hist_percentile(const hist_t * h, double percentile)
+{
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        total += h->buckets[i];
+        if (total >= rank)
+            return _min(hist_bucket_value(i), h->max);
+    }
+    return h->max;
+}
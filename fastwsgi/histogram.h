@@ -0,0 +1,52 @@
+#ifndef FASTWSGI_HISTOGRAM_H_
+#define FASTWSGI_HISTOGRAM_H_
+
+#include "common.h"
+
+// Log-linear histogram (HDR-style) with fixed memory: values below 16 have own buckets,
+// every next power of two is split into 16 linear buckets (relative error below 6.25%).
+
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP   39                // values up to 2^40 - 1
+#define HIST_BUCKETS   ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} hist_t;
+
+void hist_reset(hist_t * h);
+void hist_merge(hist_t * dst, const hist_t * src);
+uint64_t hist_bucket_value(int index);
+uint64_t hist_percentile(const hist_t * h, double percentile);
+
+INLINE
+static
+int hist_bucket_index(uint64_t value)
+{
+    if (value < HIST_SUB)
+        return (int)value;
+    if (value >= ((uint64_t)1 << (HIST_MAX_EXP + 1)))
+        return HIST_BUCKETS - 1;
+    int exp = HIST_SUB_BITS;
+    while ((value >> (exp + 1)) != 0)
+        exp++;
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + (int)((value >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+INLINE
+static
+void hist_record(hist_t * h, uint64_t value)
+{
+    // only own event loop writes into histogram (see get_latency)
+    CNT_INC(&h->buckets[hist_bucket_index(value)]);
+    CNT_INC(&h->count);
+    CNT_ADD(&h->sum, value);
+    if (value > h->max)
+        CNT_SET(&h->max, value);
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "logx.h"
+#include "ring.h"
 #ifdef _WIN32
 #include <vadefs.h>
 #endif
@@ -34,8 +35,8 @@ void set_log_level(int level)
 
 static const char log_prefix[] = "[FWSGI-X]";
 static const int log_level_pos = 7;
-static const char * log_client_addr = NULL;
-static int log_client_addr_len = 0;
+static THREAD_LOCAL const char * log_client_addr = NULL;
+static THREAD_LOCAL int log_client_addr_len = 0;
 
 void set_log_client_addr(const char * addr)
 {
@@ -43,6 +44,125 @@ void set_log_client_addr(const char * addr)
     log_client_addr_len = addr ? strlen(addr) : 0;
 }
 
+static
+void log_output(int level, const char * buf, int len)
+{
+    if (g_log_type == FW_LOG_TO_SYSLOG) {
+#ifdef _WIN32
+        OutputDebugStringA(buf);
+#else
+        //FIXME: openlog, syslog
+#endif
+    } else {
+        if (level <= LL_ERROR)
+            fputs(buf, stderr);
+        else
+            fputs(buf, stdout);
+    }
+}
+
+// ------------- asynchronous output ------------------------------------------
+
+#define LOG_NUM_SLOTS    4096
+#define LOG_BATCH_SIZE   (32*1024)
+
+static struct {
+    int refs;            // number of servers that use asynchronous output (changed under lock)
+    uv_mutex_t lock;     // serializes start and stop from event loop threads
+    volatile int active; // 1 = records are passed to writer thread
+    ring_t ring;
+    uv_thread_t thread;
+    char buf[LOG_BATCH_SIZE];
+} g_log_async;
+
+static
+void log_writer(void * arg)
+{
+    int size = 0;  // stdout records are gathered into one write
+    while (1) {
+        int stop = (int)RING_LOAD(&g_log_async.ring.stop);
+        ring_slot_t * slot;
+        while ((slot = ring_peek(&g_log_async.ring)) != NULL) {
+            int level = (int)slot->reserved;
+            int len = (int)slot->len;
+            bool to_stdout = (g_log_type != FW_LOG_TO_SYSLOG && level > LL_ERROR);
+            if (size > 0 && (!to_stdout || size + len >= LOG_BATCH_SIZE)) {
+                g_log_async.buf[size] = 0;
+                fputs(g_log_async.buf, stdout);
+                size = 0;
+            }
+            if (to_stdout) {
+                memcpy(g_log_async.buf + size, slot->data, len);
+                size += len;
+            } else {
+                log_output(level, slot->data, len);
+            }
+            ring_release(&g_log_async.ring, slot);
+        }
+        if (size > 0) {
+            g_log_async.buf[size] = 0;
+            fputs(g_log_async.buf, stdout);
+            size = 0;
+        }
+        fflush(stdout);
+        if (stop)
+            break;
+        ring_wait(&g_log_async.ring);  // woken by producer or by log_async_stop
+    }
+}
+
+static uv_once_t g_log_async_once = UV_ONCE_INIT;
+
+static
+void log_async_init_once(void)
+{
+    uv_mutex_init(&g_log_async.lock);
+}
+
+int log_async_start(void)
+{
+    int hr = 0;
+    uv_once(&g_log_async_once, log_async_init_once);
+    uv_mutex_lock(&g_log_async.lock);
+    if (g_log_async.refs > 0) {
+        CNT_SET(&g_log_async.refs, g_log_async.refs + 1);  // next event loop of process
+        goto fin;
+    }
+    FIN_IF(ring_init(&g_log_async.ring, LOG_NUM_SLOTS) != 0, -1);
+    if (uv_thread_create(&g_log_async.thread, log_writer, NULL) != 0) {
+        ring_free(&g_log_async.ring);
+        FIN(-2);
+    }
+    CNT_SET(&g_log_async.refs, 1);
+    g_log_async.active = 1;
+fin:
+    uv_mutex_unlock(&g_log_async.lock);
+    return hr;
+}
+
+void log_async_stop(void)
+{
+    uv_once(&g_log_async_once, log_async_init_once);
+    uv_mutex_lock(&g_log_async.lock);
+    if (g_log_async.refs > 1) {
+        CNT_SET(&g_log_async.refs, g_log_async.refs - 1);
+    } else if (g_log_async.refs == 1) {
+        g_log_async.active = 0;
+        ring_stop(&g_log_async.ring);
+        uv_thread_join(&g_log_async.thread);  // all records are written
+        ring_free(&g_log_async.ring);
+        CNT_SET(&g_log_async.refs, 0);
+    }
+    uv_mutex_unlock(&g_log_async.lock);
+}
+
+uint64_t log_async_drops(void)
+{
+    return (CNT_LOAD(&g_log_async.refs) > 0) ? RING_LOAD(&g_log_async.ring.drops) : 0;
+}
+
+// ----------------------------------------------------------------------------
+
 void logmsg(int level, const char * fmt, ...)
 {
     char buf[4096];
@@ -68,24 +188,27 @@ void logmsg(int level, const char * fmt, ...)
             buf[prefix_len + maxlen] = 0;
             len = (int)strlen(buf);
         } else {
-            len += prefix_len;
+            len = prefix_len + _min(len, maxlen - 1);
             buf[len] = 0;
         }
         if (buf[len - 1] != '\n') {
             buf[len++] = '\n';
             buf[len] = 0;
         }
-        if (g_log_type == FW_LOG_TO_SYSLOG) {
-#ifdef _WIN32
-            OutputDebugStringA(buf);
-#else
-            //FIXME: openlog, syslog
-#endif
-        } else {
-            if (level <= LL_ERROR)
-                fputs(buf, stderr);
-            else
-                fputs(buf, stdout);
+        if (g_log_async.active) {
+            ring_slot_t * slot = ring_reserve(&g_log_async.ring);
+            if (!slot)
+                return;  // ring is full: record dropped
+            int size = _min(len, (int)sizeof(slot->data) - 1);  // long record is truncated
+            memcpy(slot->data, buf, size);
+            if (size < len)
+                slot->data[size - 1] = '\n';
+            slot->data[size] = 0;
+            slot->len = (uint32_t)size;
+            slot->reserved = (uint32_t)level;
+            ring_publish(&g_log_async.ring, slot);
+            return;
         }
+        log_output(level, buf, len);
     }
 }
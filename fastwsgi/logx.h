@@ -33,6 +33,11 @@ void set_log_level(int level);
 void set_log_client_addr(const char * addr);
 void logmsg(int level, const char * fmt, ...);
 
+// asynchronous output: records are passed to writer thread via lock-free ring
+int log_async_start(void);
+void log_async_stop(void);
+uint64_t log_async_drops(void);
+
 #define LOGMSG(_level_, ...) if (_level_ <= g_log_level) logmsg(_level_, __VA_ARGS__)
 
 #define logger(_msg_) LOGMSG(LL_INFO, _msg_)
@@ -3,6 +3,8 @@
 #include "llhttp.h"
 #include "constants.h"
 #include "start_response.h"
+#include "filewrapper.h"
+#include "environ.h"
 #include "pyhacks.h"
 
 PyObject* g_base_dict = NULL;
@@ -82,6 +84,11 @@ int set_header(client_t * client, PyObject * key, const char * value, ssize_t le
         dict = client->request.headers;
         kname = key;
         if (key == g_cv.PATH_INFO || key == g_cv.QUERY_STRING) {
+            if (dict && Environ_CheckExact(dict)) {
+                Py_ssize_t klen = PyUnicode_GET_LENGTH(key);
+                hr = Environ_AddItem(dict, PyUnicode_AsUTF8(key), klen, value, vlen, EI_LATIN1);
+                FIN(hr);
+            }
             val = PyUnicode_DecodeLatin1(value, vlen, NULL);
         } else {
             val = PyUnicode_FromStringAndSize(value, vlen);  // as UTF-8
@@ -97,18 +104,36 @@ fin:
 }
 
 static 
-int set_header_v(client_t * client, const char * key, const char * value, ssize_t length, int flags)
+int set_header_v(client_t * client, const char * key, int hname, const char * value, ssize_t length, int flags)
 {
     if (!key)
         return -11;
     size_t klen = strlen(key);
     if (klen == 0)
         return -12;
-    PyObject * pkey;
-    if (client->asgi) {
-        pkey = PyBytes_FromStringAndSize(key, klen);
-    } else {
-        pkey = PyUnicode_FromStringAndSize(key, klen);
+    PyObject * environ = client->request.headers;
+    if (environ && Environ_CheckExact(environ)) {
+        ssize_t vlen = (length >= 0) ? length : strlen(value);
+        LOGi("set_header: %s = '%.*s' (lazy)", key, (int)vlen, value);
+        return Environ_AddItem(environ, key, klen, value, vlen, EI_HNAME(hname));
+    }
+    PyObject * pkey = NULL;
+    if (hname != HN_UNKNOWN) {
+        if (client->asgi) {
+            pkey = g_cv.header_name[hname];
+            if (memcmp(PyBytes_AS_STRING(pkey), key, klen) != 0)
+                pkey = NULL;  // header name in non-canonical case
+        } else {
+            pkey = g_cv.header_key[hname];
+        }
+        Py_XINCREF(pkey);
+    }
+    if (!pkey) {
+        if (client->asgi) {
+            pkey = PyBytes_FromStringAndSize(key, klen);
+        } else {
+            pkey = PyUnicode_FromStringAndSize(key, klen);
+        }
     }
     int retval = set_header(client, pkey, value, length, flags);
     Py_DECREF(pkey);
@@ -166,6 +191,7 @@ void reset_response_preload(client_t * client)
 
 void reset_response_body(client_t * client)
 {
+    sendfile_reset(client);
     reset_response_preload(client);
     client->response.body_total_size = 0;
 
@@ -190,6 +216,18 @@ int on_message_begin(llhttp_t * parser)
     LOGi("on_message_begin: ------------------------------");
     client_t * client = (client_t *)parser->data;
     client->request.load_state = LS_MSG_BEGIN;
+    client->num_requests++;
+    client->timing.begin = latency_now();
+    client->timing.app_start = 0;
+    client->alog.path_len = 0;
+    client->alog.status = 0;
+    CNT_INC(&g_srv.stats.requests);
+    if (client->num_requests > 1)
+        CNT_INC(&g_srv.stats.keepalive_reuse);
+    if (client->pipeline.status >= PS_ACTIVE)
+        CNT_INC(&g_srv.stats.pipelined);
+    if (client->timeout.kind != CT_HEADERS)  // deadline of first request is started on accept
+        client_timeout_set(client, CT_HEADERS);
     if (client->head.data == NULL)
         xbuf_init2(&client->head, client->buf_head_prealloc, sizeof(client->buf_head_prealloc));
     //client->request.keep_alive = 0;
@@ -203,7 +241,11 @@ int on_message_begin(llhttp_t * parser)
         Py_CLEAR(client->request.headers);  // wsgi_input: refcnt 2 -> 1
         // Sets up base request dict for new incoming requests
         // https://www.python.org/dev/peps/pep-3333/#specification-details
-        client->request.headers = PyDict_Copy(g_base_dict);
+        if (g_srv.lazy_environ) {
+            client->request.headers = Environ_New(g_base_dict);
+        } else {
+            client->request.headers = PyDict_Copy(g_base_dict);
+        }
     }
     client->request.http_content_length = -1; // not specified
     client->request.chunked = 0;
@@ -234,6 +276,12 @@ int on_url_complete(llhttp_t * parser)
     client_t * client = (client_t *)parser->data;
     client->request.load_state = LS_MSG_URL;
     xbuf_t * buf = &client->head;
+    if (g_srv.access_log) {
+        client->alog.method = (int)parser->method;
+        client->alog.http_minor = (int)parser->http_minor;
+        client->alog.path_len = _min(buf->size, (int)sizeof(client->alog_path));
+        memcpy(client->alog_path, buf->data, client->alog.path_len);
+    }
     LOGi("%s: \"%s\"", __func__, buf->data);
     char * path = buf->data;
     ssize_t path_len = buf->size;
@@ -328,15 +376,6 @@ int on_header_value(llhttp_t * parser, const char * data, size_t length)
     return 0;
 }
 
-typedef enum {
-    HN_UNKNOWN           = 0,
-    HN_CONTENT_LENGTH    = 1,
-    HN_CONTENT_TYPE      = 2,
-    HN_TRANSFER_ENCODING = 3,
-    HN_EXPECT            = 4,
-    HN__MAX
-} header_name_t;
-
 int on_header_value_complete(llhttp_t * parser)
 {
     client_t * client = (client_t *)parser->data;
@@ -351,30 +390,8 @@ int on_header_value_complete(llhttp_t * parser)
         LOGw("%s: Headers has an unnamed value!", __func__);        
         return 0;  // skip incorrect header
     }
-    header_name_t hname = HN_UNKNOWN;
-    if (client->asgi) {
-        if (key_len == 14 && strcasecmp(key, "CONTENT-LENGTH") == 0)
-            hname = HN_CONTENT_LENGTH;
-        else if (key_len == 12 && strcasecmp(key, "CONTENT-TYPE") == 0)
-            hname = HN_CONTENT_TYPE;
-        else if (key_len == 17 && strcasecmp(key, "TRANSFER-ENCODING") == 0)
-            hname = HN_TRANSFER_ENCODING;
-        else if (key_len == 6 && strcasecmp(key, "EXPECT") == 0)
-            hname = HN_EXPECT;
-    } else {
-        if (key_len == 19 && strncmp(key, "HTTP_CONTENT_LENGTH", 19) == 0)
-            hname = HN_CONTENT_LENGTH;
-        else if (key_len == 17 && strncmp(key, "HTTP_CONTENT_TYPE", 17) == 0)
-            hname = HN_CONTENT_TYPE;
-        else if (key_len == 22 && strncmp(key, "HTTP_TRANSFER_ENCODING", 22) == 0)
-            hname = HN_TRANSFER_ENCODING;
-        else if (key_len == 11 && strncmp(key, "HTTP_EXPECT", 11) == 0)
-            hname = HN_EXPECT;
-    }
-    if (hname == HN_UNKNOWN) {
-        // nothing
-    }
-    else if (hname == HN_CONTENT_LENGTH) {
+    int hname = find_header_name(key + prefix_len, key_len - prefix_len);
+    if (hname == HN_CONTENT_LENGTH) {
         client->request.http_content_length = 0; // field "Content-Length" present
         key += prefix_len;  // exclude prefix "HTTP_"
     }
@@ -406,7 +423,7 @@ int on_header_value_complete(llhttp_t * parser)
         key = NULL;  // hide Expect header
     }
     if (key)
-        set_header_v(client, key, val, val_len, 0);
+        set_header_v(client, key, hname, val, val_len, 0);
 
     reset_head_buffer(client);
     return 0;
@@ -416,6 +433,7 @@ int on_headers_complete(llhttp_t * parser)
 {
     client_t * client = (client_t *)parser->data;
     client->request.load_state = LS_MSG_HEADERS;
+    client_timeout_set(client, CT_BODY);
     uint64_t clen = parser->content_length;
     LOGi("%s: %s", __func__, (client->request.chunked) ? "(chunked)" : "");
     reset_head_buffer(client);
@@ -501,6 +519,7 @@ int on_message_complete(llhttp_t * parser)
     LOGi("%s", __func__);
     client_t * client = (client_t *)parser->data;
     client->request.load_state = LS_MSG_END;
+    client_timeout_del(client);
 
     if (llhttp_should_keep_alive(parser)) {
         client->request.keep_alive = 1;
@@ -658,7 +677,12 @@ int process_wsgi_response(client_t * client)
         err = HTTP_STATUS_INTERNAL_SERVER_ERROR;
         goto fin;
     }
-    err = wsgi_body_pleload(client, wsgi_body);
+    err = -1;
+    if (FileWrapper_CheckExact(wsgi_body))
+        err = sendfile_prepare(client, wsgi_body);  // zero-copy transfer of file
+
+    if (err)
+        err = wsgi_body_pleload(client, wsgi_body);
     if (err < 0) {
         LOGc("wsgi_body_pleload return error = %d", err);
         err = HTTP_STATUS_INTERNAL_SERVER_ERROR;
@@ -698,6 +722,151 @@ int create_response(client_t * client)
     return err;
 }
 
+static
+void hdr_cache_clear(hdr_cache_entry_t * entry)
+{
+    if (!entry->status)
+        return;
+    Py_CLEAR(entry->status);
+    for (int i = 0; i < entry->num_items; i++)
+        Py_CLEAR(entry->items[i]);
+    entry->num_items = 0;
+    free(entry->data);
+    entry->data = NULL;
+}
+
+void hdr_cache_free(void)
+{
+    for (int i = 0; i < HDR_CACHE_SIZE; i++)
+        hdr_cache_clear(&g_srv.hdr_cache.entries[i]);
+}
+
+static
+bool is_content_length(PyObject * key)
+{
+    if (PyUnicode_GET_LENGTH(key) != 14)
+        return false;
+    const char * str = PyUnicode_AsUTF8(key);
+    return str && strcasecmp(str, "Content-Length") == 0;
+}
+
+static
+int parse_content_length(const char * value, Py_ssize_t value_len, int64_t * clen)
+{
+    if (value_len == 0)
+        return -2;  // error
+    if (value_len == 1 && value[0] == '0') {
+        *clen = 0;
+        return 0;
+    }
+    int64_t len = strtoll(value, NULL, 10);
+    if (len <= 0 || len == LLONG_MAX)
+        return -3;  // error
+    *clen = len;
+    return 0;
+}
+
+#define UNICODE_EQ(_a_, _b_)  ((_a_) == (_b_) || PyUnicode_Compare((_a_), (_b_)) == 0)
+
+static
+bool hdr_cache_match(hdr_cache_entry_t * entry, StartResponse * response, size_t hash, int clen_index, int64_t * clen)
+{
+    Py_ssize_t num_items = PyList_GET_SIZE(response->headers);
+    if (!entry->status || entry->hash != hash || entry->num_items != (int)num_items || entry->clen_index != clen_index)
+        return false;
+    if (!UNICODE_EQ(entry->status, response->status))
+        return false;
+    int64_t content_length = entry->content_length;
+    for (Py_ssize_t i = 0; i < num_items; i++) {
+        PyObject * tuple = PyList_GET_ITEM(response->headers, i);
+        PyObject * item = entry->items[i];
+        if (tuple == item)
+            continue;  // the same constant tuple
+        if (!UNICODE_EQ(PyTuple_GET_ITEM(tuple, 0), PyTuple_GET_ITEM(item, 0)))
+            return false;
+        if (i == clen_index) {
+            // value of "Content-Length" is not part of cached block
+            Py_ssize_t value_len = 0;
+            const char * value = PyUnicode_AsUTF8AndSize(PyTuple_GET_ITEM(tuple, 1), &value_len);
+            if (!value || parse_content_length(value, value_len, &content_length) != 0) {
+                PyErr_Clear();
+                return false;
+            }
+            continue;
+        }
+        if (!UNICODE_EQ(PyTuple_GET_ITEM(tuple, 1), PyTuple_GET_ITEM(item, 1)))
+            return false;
+    }
+    *clen = (clen_index >= 0) ? content_length : -1;
+    return true;
+}
+
+// Looks up serialized headers by content of status and header tuples.
+// Missed headers replace cache entry only when they repeat, so headers with values
+// that change per response (Date, Set-Cookie, etc) do not evict other entries.
+static
+void hdr_cache_lookup(client_t * client, StartResponse * response)
+{
+    client->response.hdr_cache.headers = NULL;
+    client->response.hdr_cache.entry = NULL;
+    client->response.hdr_cache.hit = false;
+    if (!g_srv.hdr_cache.enabled || !response->status || !response->headers)
+        return;
+    Py_ssize_t num_items = PyList_GET_SIZE(response->headers);
+    if (num_items > HDR_CACHE_MAX_ITEMS || !PyUnicode_Check(response->status))
+        return;
+    size_t hash = (size_t)PyObject_Hash(response->status);
+    int clen_index = -1;
+    for (Py_ssize_t i = 0; i < num_items; i++) {
+        PyObject * tuple = PyList_GET_ITEM(response->headers, i);
+        PyObject * key = PyTuple_GET_ITEM(tuple, 0);
+        PyObject * val = PyTuple_GET_ITEM(tuple, 1);
+        if (!PyUnicode_Check(key) || !PyUnicode_Check(val))
+            return;
+        hash = hash * 31 + (size_t)PyObject_Hash(key);  // hash of str is cached by object
+        if (clen_index < 0 && is_content_length(key))
+            clen_index = (int)i;
+        else
+            hash = hash * 31 + (size_t)PyObject_Hash(val);
+    }
+    hdr_cache_entry_t * entry = &g_srv.hdr_cache.entries[hash % HDR_CACHE_SIZE];
+    client->response.hdr_cache.headers = response->headers;
+    if (hdr_cache_match(entry, response, hash, clen_index, &client->response.wsgi_content_length)) {
+        client->response.hdr_cache.entry = entry;
+        client->response.hdr_cache.hit = true;
+        return;
+    }
+    if (!entry->status || entry->pending == hash)
+        client->response.hdr_cache.entry = entry;  // free entry or repeated headers
+    entry->pending = hash;
+}
+
+static
+void hdr_cache_store(hdr_cache_entry_t * entry, StartResponse * response, int status, bool date_present, int64_t content_length, xbuf_t * head)
+{
+    hdr_cache_clear(entry);
+    entry->data = (char *)malloc(head->size);
+    if (!entry->data)
+        return;
+    memcpy(entry->data, head->data, head->size);
+    entry->size = head->size;
+    entry->hash = entry->pending;  // see hdr_cache_lookup
+    entry->status_code = status;
+    entry->date_present = date_present;
+    entry->clen_index = -1;
+    entry->content_length = content_length;  // see get_info_from_wsgi_response
+    // held references keep content of matched objects (str and tuple are immutable)
+    entry->num_items = (int)PyList_GET_SIZE(response->headers);
+    for (int i = 0; i < entry->num_items; i++) {
+        entry->items[i] = PyList_GET_ITEM(response->headers, i);
+        Py_INCREF(entry->items[i]);
+        if (entry->clen_index < 0 && is_content_length(PyTuple_GET_ITEM(entry->items[i], 0)))
+            entry->clen_index = i;
+    }
+    entry->status = response->status;
+    Py_INCREF(entry->status);
+}
+
 int build_response(client_t * client, int flags, int status, const void * headers, const void * body_data, int _body_size)
 {
     int hr = 0;
@@ -709,10 +878,24 @@ int build_response(client_t * client, int flags, int status, const void * header
     int64_t body_size = _body_size;
     bool resp_date_present = false;
     bool resp_server_present = false;
+    hdr_cache_entry_t * cache = NULL;
+    bool cache_lookup = false;
+    bool cache_hit = false;
 
     if (flags & RF_HEADERS_WSGI) {
         response = (StartResponse *)headers;
         headers = NULL;
+        if (client->response.hdr_cache.headers && client->response.hdr_cache.headers == response->headers) {
+            cache_lookup = true;  // see get_info_from_wsgi_response
+            cache = client->response.hdr_cache.entry;
+            cache_hit = client->response.hdr_cache.hit;
+        }
+        client->response.hdr_cache.headers = NULL;
+    }
+    if (cache_hit) {
+        status = cache->status_code;
+    }
+    else if (response) {
         char scode[4];
         Py_ssize_t status_len = 0;
         const char * status_code = PyUnicode_AsUTF8AndSize(response->status, &status_len);
@@ -735,6 +918,17 @@ int build_response(client_t * client, int flags, int status, const void * header
         reset_response_body(client);  // forced reset body buffers
     }
 
+    client->alog.status = status;
+    if (status >= 500)
+        CNT_INC(&g_srv.stats.status_5xx);
+    else if (status >= 400)
+        CNT_INC(&g_srv.stats.status_4xx);
+    if (cache_hit) {
+        xbuf_add(head, cache->data, cache->size);
+        resp_date_present = cache->date_present;
+        CNT_INC(&g_srv.hdr_cache.hits);
+        goto dynamic_headers;
+    }
     const char * status_name = get_http_status_name(status);
     FIN_IF(!status_name, -3);
 
@@ -819,6 +1013,18 @@ int build_response(client_t * client, int flags, int status, const void * header
         xbuf_add_str(head, (const char *)headers);
     }
 
+    if (!resp_server_present && g_srv.add_header_server > 0) {
+        xbuf_add(head, "Server: ", 8);
+        xbuf_add(head, g_srv.header_server, g_srv.add_header_server);
+        xbuf_add(head, "\r\n", 2);
+    }
+    if (cache_lookup) {
+        if (cache)
+            hdr_cache_store(cache, response, status, resp_date_present, client->response.wsgi_content_length, head);
+        CNT_INC(&g_srv.hdr_cache.misses);
+    }
+
+dynamic_headers:
     if (!resp_date_present && g_srv.add_header_date) {
         char * date_str;
         int date_len = get_asctime(&date_str);
@@ -826,14 +1032,26 @@ int build_response(client_t * client, int flags, int status, const void * header
         xbuf_add(head, date_str, date_len);
         xbuf_add(head, "\r\n", 2);
     }
-    if (!resp_server_present && g_srv.add_header_server > 0) {
-        xbuf_add(head, "Server: ", 8);
-        xbuf_add(head, g_srv.header_server, g_srv.add_header_server);
-        xbuf_add(head, "\r\n", 2);
-    }
 
+    if (g_srv.keep_alive_requests > 0 && client->num_requests >= g_srv.keep_alive_requests) {
+        flags &= ~RF_SET_KEEP_ALIVE;
+        client->request.keep_alive = 0;  // connection will be closed after sending the response
+    }
+    if (g_srv.drain.active && client->pipeline.status == PS_RESTING) {
+        flags &= ~RF_SET_KEEP_ALIVE;
+        client->request.keep_alive = 0;  // server is going to exit
+    }
     if ((flags & RF_SET_KEEP_ALIVE) != 0 && client->srv->allow_keepalive) {
         xbuf_add_str(head, "Connection: keep-alive\r\n");
+        if (g_srv.keep_alive_timeout > 0) {
+            char * buf = xbuf_expand(head, 64);
+            if (g_srv.keep_alive_requests > 0) {
+                int max = g_srv.keep_alive_requests - client->num_requests;
+                head->size += sprintf(buf, "Keep-Alive: timeout=%d, max=%d\r\n", g_srv.keep_alive_timeout, max);
+            } else {
+                head->size += sprintf(buf, "Keep-Alive: timeout=%d\r\n", g_srv.keep_alive_timeout);
+            }
+        }
     } else {
         xbuf_add_str(head, "Connection: close\r\n");
     }
@@ -897,6 +1115,9 @@ fin:
 int get_info_from_wsgi_response(client_t * client)
 {
     StartResponse * response = client->start_response;
+    hdr_cache_lookup(client, response);
+    if (client->response.hdr_cache.hit)
+        return 0;  // content length taken from cached headers
     client->response.wsgi_content_length = -1;  // unknown
     Py_ssize_t hsize = PyList_GET_SIZE(response->headers);
     for (Py_ssize_t i = 0; i < hsize; i++) {
@@ -906,16 +1127,10 @@ int get_info_from_wsgi_response(client_t * client)
         Py_ssize_t value_len = 0;
         const char * value = PyUnicode_AsUTF8AndSize(PyTuple_GET_ITEM(tuple, 1), &value_len);
         if (key_len == 14 && key[7] == '-' && strcasecmp(key, "Content-Length") == 0) {
-            if (value_len == 0)
-                return -2;  // error
             int64_t clen;
-            if (value_len == 1 && value[0] == '0') {
-                clen = 0;
-            } else {
-                clen = strtoll(value, NULL, 10);
-                if (clen <= 0 || clen == LLONG_MAX)
-                    return -3;  // error
-            }
+            int hr = parse_content_length(value, value_len, &clen);
+            if (hr)
+                return hr;  // error
             LOGi("wsgi response: content-length = %lld", (long long)clen);
             client->response.wsgi_content_length = clen;
         }
@@ -1094,8 +1309,9 @@ void init_request_dict()
     PyDict_SetItem(g_base_dict, g_cv.wsgi_url_scheme, g_cv.http_scheme);
     PyDict_SetItem(g_base_dict, g_cv.wsgi_errors, PySys_GetObject("stderr"));
     PyDict_SetItem(g_base_dict, g_cv.wsgi_run_once, Py_False);
-    PyDict_SetItem(g_base_dict, g_cv.wsgi_multithread, Py_False);
+    PyDict_SetItem(g_base_dict, g_cv.wsgi_multithread, (g_srv.num_threads > 1) ? Py_True : Py_False);
     PyDict_SetItem(g_base_dict, g_cv.wsgi_multiprocess, Py_True);
+    PyDict_SetItem(g_base_dict, g_cv.wsgi_file_wrapper, (PyObject *)&FileWrapper_Type);
     Py_DECREF(port);
     Py_DECREF(host);
 }
@@ -0,0 +1,164 @@
+#ifndef FASTWSGI_RING_H_
+#define FASTWSGI_RING_H_
+
+#include "common.h"
+
+// Bounded lock-free MPSC ring of fixed-size slots.
+// Producers (event loop threads) reserve a slot with CAS, fill it and publish it by slot sequence.
+// Single consumer (writer thread) takes published slots in order. Full ring drops the record.
+// Idle consumer sleeps on condvar, producer takes the lock only when consumer is sleeping.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RING_LOAD(_ptr_)              (*(volatile uint64_t *)(_ptr_))  // x86/x64: plain load has acquire semantics
+#define RING_STORE(_ptr_, _val_)      (*(volatile uint64_t *)(_ptr_) = (_val_))
+#define RING_CAS(_ptr_, _exp_, _val_) (_InterlockedCompareExchange64((volatile __int64 *)(_ptr_), (__int64)(_val_), (__int64)(_exp_)) == (__int64)(_exp_))
+#define RING_INC(_ptr_)               _InterlockedIncrement64((volatile __int64 *)(_ptr_))
+#define RING_FENCE()                  MemoryBarrier()
+#else
+#define RING_LOAD(_ptr_)              __atomic_load_n((_ptr_), __ATOMIC_ACQUIRE)
+#define RING_STORE(_ptr_, _val_)      __atomic_store_n((_ptr_), (_val_), __ATOMIC_RELEASE)
+#define RING_CAS(_ptr_, _exp_, _val_) ({ uint64_t _e_ = (_exp_); __atomic_compare_exchange_n((_ptr_), &_e_, (_val_), false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED); })
+#define RING_INC(_ptr_)               __atomic_add_fetch((_ptr_), 1, __ATOMIC_RELAXED)
+#define RING_FENCE()                  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define RING_SLOT_SIZE  512
+
+typedef struct {
+    uint64_t seq;        // == position: free for producer; == position + 1: published for consumer
+    uint32_t len;
+    uint32_t reserved;   // data aligned to 8 bytes
+    char data[RING_SLOT_SIZE - 2 * sizeof(uint64_t)];
+} ring_slot_t;
+
+typedef struct {
+    ring_slot_t * slots;
+    uint64_t mask;       // number of slots - 1
+    char _pad1[64];
+    uint64_t head;       // next position for producers
+    char _pad2[64];
+    uint64_t tail;       // next position for consumer
+    uint64_t drops;      // records dropped on full ring
+    uint64_t waiting;    // 1 = consumer sleeps into ring_wait
+    uint64_t stop;       // 1 = consumer must take remaining slots and exit
+    uv_mutex_t lock;
+    uv_cond_t cond;
+} ring_t;
+
+INLINE
+static
+int ring_init(ring_t * ring, int num_slots)
+{
+    uint64_t size = 64;
+    while (size < (uint64_t)num_slots)
+        size <<= 1;
+    memset(ring, 0, sizeof(ring_t));
+    ring->slots = (ring_slot_t *)malloc(size * sizeof(ring_slot_t));
+    if (!ring->slots)
+        return -1;
+    for (uint64_t i = 0; i < size; i++)
+        ring->slots[i].seq = i;
+    ring->mask = size - 1;
+    uv_mutex_init(&ring->lock);
+    uv_cond_init(&ring->cond);
+    return 0;
+}
+
+INLINE
+static
+void ring_free(ring_t * ring)
+{
+    if (!ring->slots)
+        return;
+    free(ring->slots);
+    ring->slots = NULL;
+    uv_cond_destroy(&ring->cond);
+    uv_mutex_destroy(&ring->lock);
+}
+
+INLINE
+static
+void ring_wake(ring_t * ring)
+{
+    uv_mutex_lock(&ring->lock);
+    uv_cond_signal(&ring->cond);
+    uv_mutex_unlock(&ring->lock);
+}
+
+// returns slot for filling (NULL = ring is full)
+INLINE
+static
+ring_slot_t * ring_reserve(ring_t * ring)
+{
+    uint64_t pos = RING_LOAD(&ring->head);
+    while (1) {
+        ring_slot_t * slot = &ring->slots[pos & ring->mask];
+        int64_t diff = (int64_t)(RING_LOAD(&slot->seq) - pos);
+        if (diff == 0) {
+            if (RING_CAS(&ring->head, pos, pos + 1))
+                return slot;
+        } else if (diff < 0) {
+            RING_INC(&ring->drops);
+            return NULL;
+        }
+        pos = RING_LOAD(&ring->head);
+    }
+}
+
+INLINE
+static
+void ring_publish(ring_t * ring, ring_slot_t * slot)
+{
+    uint64_t pos = slot->seq;
+    RING_STORE(&slot->seq, pos + 1);
+    RING_FENCE();  // pairs with fence into ring_wait
+    if (RING_LOAD(&ring->waiting))
+        ring_wake(ring);
+}
+
+// consumer only: returns next published slot (NULL = ring is empty)
+INLINE
+static
+ring_slot_t * ring_peek(ring_t * ring)
+{
+    ring_slot_t * slot = &ring->slots[ring->tail & ring->mask];
+    if (RING_LOAD(&slot->seq) != ring->tail + 1)
+        return NULL;
+    return slot;
+}
+
+// consumer only: returns slot to producers
+INLINE
+static
+void ring_release(ring_t * ring, ring_slot_t * slot)
+{
+    RING_STORE(&slot->seq, ring->tail + ring->mask + 1);
+    ring->tail++;
+}
+
+// consumer only: sleeps until next slot is published or ring_stop is called
+INLINE
+static
+void ring_wait(ring_t * ring)
+{
+    uv_mutex_lock(&ring->lock);
+    RING_STORE(&ring->waiting, 1);
+    RING_FENCE();  // pairs with fence into ring_publish
+    while (!ring_peek(ring) && !RING_LOAD(&ring->stop))
+        uv_cond_wait(&ring->cond, &ring->lock);
+    RING_STORE(&ring->waiting, 0);
+    uv_mutex_unlock(&ring->lock);
+}
+
+INLINE
+static
+void ring_stop(ring_t * ring)
+{
+    uv_mutex_lock(&ring->lock);
+    RING_STORE(&ring->stop, 1);
+    uv_cond_signal(&ring->cond);
+    uv_mutex_unlock(&ring->lock);
+}
+
+#endif
@@ -6,12 +6,30 @@
 #include "uv-common.h"
 #include "llhttp.h"
 
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <linux/filter.h>
+#endif
+
 #include "server.h"
 #include "request.h"
 #include "constants.h"
+#include "filewrapper.h"
+#include "environ.h"
+#include "accesslog.h"
 
-server_t g_srv;
-static int g_srv_inited = 0;
+static server_t g_srv_main;
+THREAD_LOCAL server_t * g_srv_ptr = &g_srv_main;
+static THREAD_LOCAL int g_srv_inited = 0;
+static server_t * g_srv_list = NULL;  // all running servers of process (protected by GIL)
 
 #define MAGIC_CLIENT ((void *)0xFFAB4321)
 
@@ -20,21 +38,15 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf);
 int stream_write(client_t * client);
 
 void idle_worker_cb(uv_idle_t * handle);
-void pipeline_cb(uv_handle_t * handle, void * arg);
 int pipeline_close(client_t * client, bool start_reading);
+static void process_read(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf);
 
 void free_read_buffer(client_t * client, void * data)
 {
-    for (size_t i = 0; i < ARRAY_SIZE(client->rbuf); i++) {
-        xbuf_t * r_buf = &client->rbuf[i];
-        if (data && r_buf->data == data) {
-            //LOGi("%s: free buffer = %p", __func__, data);
-            r_buf->size = 0;  // free buffer
-            return;
-        }
-        if (!data) {
-            xbuf_free(r_buf);
-        }
+    if (client->rbuf && (!data || client->rbuf == data)) {
+        //LOGi("%s: free buffer = %p", __func__, client->rbuf);
+        bufpool_put(&g_srv.rbuf_pool, client->rbuf);  // return buffer to pool
+        client->rbuf = NULL;
     }
 }
 
@@ -57,6 +69,68 @@ int stream_read_stop(client_t * client)
     return 0;
 }
 
+static
+client_t * client_alloc()
+{
+    client_t * client = (client_t *)g_srv.client_pool.head;
+    if (client) {
+        g_srv.client_pool.head = *(void **)client;
+        g_srv.client_pool.size--;
+        CNT_INC(&g_srv.client_pool.hits);
+    } else {
+        client = (client_t *)malloc(sizeof(client_t));
+        if (!client)
+            return NULL;
+        CNT_INC(&g_srv.client_pool.misses);
+    }
+    // preallocated buffers are initialized on demand and do not require zeroing
+    memset(client, 0, offsetof(client_t, buf_head_prealloc));
+    return client;
+}
+
+static
+void client_free(client_t * client)
+{
+    if (g_srv.client_pool.size < g_srv.client_pool.max_size) {
+        *(void **)client = g_srv.client_pool.head;
+        g_srv.client_pool.head = client;
+        g_srv.client_pool.size++;
+        return;
+    }
+    free(client);
+}
+
+static
+void client_pool_free()
+{
+    LOGn("%s: hits = %llu, misses = %llu", __func__,
+        (unsigned long long)g_srv.client_pool.hits, (unsigned long long)g_srv.client_pool.misses);
+    void * block = g_srv.client_pool.head;
+    while (block) {
+        void * next = *(void **)block;
+        free(block);
+        block = next;
+    }
+    g_srv.client_pool.head = NULL;
+    g_srv.client_pool.size = 0;
+}
+
+static
+void server_drain_check()
+{
+    if (!g_srv.drain.active || g_srv.num_clients > 0)
+        return;
+    LOGn("%s: all connections are closed", __func__);
+    if (g_srv.drain.timer.type == UV_TIMER)
+        uv_timer_stop(&g_srv.drain.timer);
+    if (g_srv.asgi_app) {
+        PyObject * res = PyObject_CallMethod(g_srv.aio.loop.self, "stop", NULL);
+        Py_XDECREF(res);
+        return;
+    }
+    uv_stop(g_srv.loop);
+}
+
 typedef enum {
     CA_OK           = 0,  // continue read from socket
     CA_CLOSE        = 1,
@@ -66,20 +140,29 @@ typedef enum {
 void close_cb(uv_handle_t * handle)
 {
     client_t * client = (client_t *)handle;
+    GIL_ENSURE();
     before_loop_callback(client);
     update_log_prefix(client);
     LOGn("disconnected =================================");
+    CNT_DEC(&g_srv.num_clients);
+    CNT_INC(&g_srv.stats.conn_closed);
+    client_timeout_del(client);
     pipeline_close(client, false);
     Py_XDECREF(client->request.headers);
     Py_XDECREF(client->request.wsgi_input_empty);
     Py_XDECREF(client->request.wsgi_input);
     xbuf_free(&client->head);
+    xbuf_free(&client->batch);
+    xbuf_free(&client->batch_done);
     free_start_response(client);
     reset_response_body(client);
     free_read_buffer(client, NULL);
     asgi_free(client);
-    free(client);
+    client_free(client);
     update_log_prefix(NULL);
+    server_drain_check();
+    accept_resume();
+    GIL_RELEASE();
 }
 
 void close_connection(client_t * client)
@@ -123,7 +206,7 @@ typedef struct {
 
 void x_write_cb(uv_write_t * req, int status)
 {
-    g_srv.num_writes--;
+    CNT_DEC(&g_srv.num_writes);
     free(req);
 }
 
@@ -144,18 +227,251 @@ int x_send_status(client_t * client, int status)
     wreq->buf.base = buf;
     LOGi("%s: \"%s\"", __func__, buf);
     uv_write((uv_write_t*)wreq, (uv_stream_t*)client, &wreq->buf, 1, x_write_cb);
-    g_srv.num_writes++;
+    CNT_INC(&g_srv.num_writes);
     return 0;
 }
 
-void write_cb(uv_write_t * req, int status)
+// ============== sendfile ============================================================
+
+#ifdef __linux__
+
+typedef struct {
+    uv_poll_t handle;   // Placement strictly at the beginning of the structure!
+    client_t * client;
+    uv_os_fd_t fd;      // duplicate of socket descriptor (libuv not allow two watchers for one fd)
+} sf_poll_t;
+
+static void process_write(uv_write_t * req, int status);
+static void sendfile_pump(client_t * client);
+
+static
+void sf_poll_close_cb(uv_handle_t * handle)
+{
+    sf_poll_t * sp = (sf_poll_t *)handle;
+    close(sp->fd);
+    free(sp);
+}
+
+static
+void sendfile_complete(client_t * client, int status)
+{
+    CNT_INC(&g_srv.num_writes);  // balanced by process_write
+    process_write((uv_write_t *)&client->response.write_req, status);
+}
+
+static
+void sf_poll_cb(uv_poll_t * handle, int status, int events)
+{
+    sf_poll_t * sp = (sf_poll_t *)handle;
+    client_t * client = sp->client;
+    GIL_ENSURE();
+    before_loop_callback(client);
+    update_log_prefix(client);
+    uv_poll_stop(handle);
+    if (status < 0) {
+        LOGe("%s: poll error: %s", __func__, uv_strerror(status));
+        sendfile_complete(client, status);
+    } else {
+        sendfile_pump(client);
+    }
+    GIL_RELEASE();
+}
+
+static
+int sendfile_wait(client_t * client, uv_os_fd_t sock)
+{
+    sf_poll_t * sp = (sf_poll_t *)client->response.sendfile.poll;
+    if (!sp) {
+        sp = (sf_poll_t *)malloc(sizeof(sf_poll_t));
+        if (!sp)
+            return UV_ENOMEM;
+        sp->client = client;
+        sp->fd = dup(sock);
+        if (sp->fd < 0) {
+            free(sp);
+            return uv_translate_sys_error(errno);
+        }
+        int err = uv_poll_init(g_srv.loop, &sp->handle, sp->fd);
+        if (err) {
+            close(sp->fd);
+            free(sp);
+            return err;
+        }
+        client->response.sendfile.poll = sp;
+    }
+    return uv_poll_start(&sp->handle, UV_WRITABLE, sf_poll_cb);
+}
+
+static
+void sendfile_pump(client_t * client)
+{
+    int err = 0;
+    uv_os_fd_t sock = -1;
+    uv_fileno((uv_handle_t *)client, &sock);
+    while (client->response.sendfile.remain > 0) {
+        size_t len = (size_t)_min(client->response.sendfile.remain, (int64_t)0x7FFFF000);
+        off_t offset = (off_t)client->response.sendfile.offset;
+        ssize_t n = sendfile(sock, client->response.sendfile.fd, &offset, len);
+        if (n > 0) {
+            client->response.sendfile.offset += n;
+            client->response.sendfile.remain -= n;
+            client->response.body_total_written += n;
+            CNT_ADD(&g_srv.stats.bytes_out, n);
+            continue;
+        }
+        if (n == 0) {
+            LOGe("%s: unexpected end of file (remain = %lld)", __func__, (long long)client->response.sendfile.remain);
+            err = UV_EOF;
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            err = sendfile_wait(client, sock);
+            if (err == 0)
+                return;  // continue when the socket becomes writable
+            break;
+        }
+        err = uv_translate_sys_error(errno);
+        LOGe("%s: sendfile error: %s", __func__, uv_strerror(err));
+        break;
+    }
+    LOGd_IF(!err, "%s: file completely sended", __func__);
+    sendfile_complete(client, err);
+}
+
+#endif  // __linux__
+
+int sendfile_prepare(client_t * client, PyObject * wsgi_body)
+{
+#ifdef __linux__
+    int fd = -1;
+    int64_t offset = 0;
+    int64_t size = 0;
+    if (FileWrapper_GetFile(wsgi_body, &fd, &offset, &size) != 0)
+        return -1;  // wrapped object is not a regular file
+    int64_t clen = client->response.wsgi_content_length;
+    if (clen >= 0 && clen < size)
+        size = clen;
+    if (size <= 0)
+        return -2;
+    client->response.sendfile.fd = fd;
+    client->response.sendfile.offset = offset;
+    client->response.sendfile.remain = size;
+    client->response.body_total_size = size;
+    client->response.body_preloaded_size = 0;
+    LOGi("wsgi_body: file will be transferred via sendfile (fd = %d, size = %lld)", fd, (long long)size);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void sendfile_reset(client_t * client)
+{
+#ifdef __linux__
+    sf_poll_t * sp = (sf_poll_t *)client->response.sendfile.poll;
+    if (sp) {
+        client->response.sendfile.poll = NULL;
+        uv_poll_stop(&sp->handle);
+        uv_close((uv_handle_t *)sp, sf_poll_close_cb);
+    }
+#endif
+    client->response.sendfile.remain = 0;
+}
+
+static
+void request_record(client_t * client, uint64_t begin, int status, int method, int http_minor,
+                    int64_t body_size, const char * path, int path_len)
+{
+    uint64_t duration = latency_now() - begin;
+    latency_record(&g_srv.latency.ttlb, duration);
+    if (g_srv.access_log) {
+        access_log_add(status, method, http_minor, body_size, duration, client->remote_addr, path, path_len);
+    }
+}
+
+static
+void request_complete(client_t * client, int64_t body_size)
+{
+    if (client->timing.begin == 0)
+        return;  // already counted
+    request_record(client, client->timing.begin, client->alog.status, client->alog.method,
+                   client->alog.http_minor, body_size, client->alog_path, client->alog.path_len);
+    client->timing.begin = 0;
+}
+
+typedef struct {
+    uint64_t begin;      // start of request (us)
+    int64_t body_size;
+    int size;            // full size of record (aligned)
+    int status;
+    int method;
+    int http_minor;
+    int path_len;
+    // request target (path_len bytes)
+} batch_rec_t;
+
+// Response added into batch is completed only after write of batch
+static
+void batch_defer(client_t * client, int64_t body_size)
+{
+    if (client->timing.begin == 0)
+        return;  // already counted
+    int path_len = (g_srv.access_log) ? client->alog.path_len : 0;
+    size_t size = (sizeof(batch_rec_t) + path_len + 7) & ~(size_t)7;
+    batch_rec_t * rec = (batch_rec_t *)xbuf_expand(&client->batch_done, size);
+    if (rec) {
+        rec->begin = client->timing.begin;
+        rec->body_size = body_size;
+        rec->size = (int)size;
+        rec->status = client->alog.status;
+        rec->method = client->alog.method;
+        rec->http_minor = client->alog.http_minor;
+        rec->path_len = path_len;
+        memcpy(rec + 1, client->alog_path, path_len);
+        client->batch_done.size += (int)size;
+    }
+    client->timing.begin = 0;
+}
+
+static
+void batch_complete(client_t * client, int status)
+{
+    char * end = client->batch_done.data + client->batch_done.size;
+    for (char * ptr = client->batch_done.data; status == 0 && ptr < end; ) {
+        batch_rec_t * rec = (batch_rec_t *)ptr;
+        request_record(client, rec->begin, rec->status, rec->method, rec->http_minor,
+                       rec->body_size, (const char *)(rec + 1), rec->path_len);
+        ptr += rec->size;
+    }
+    xbuf_reset(&client->batch_done);
+}
+
+static
+void process_write(uv_write_t * req, int status)
 {
     int close_conn = 0;
+    int done = 0;  // response sended completely
     write_req_t * wreq = (write_req_t*)req;
     client_t * client = (client_t *)wreq->client;
-    g_srv.num_writes--;
+    CNT_DEC(&g_srv.num_writes);
     before_loop_callback(client);
     update_log_prefix(client);
+    xbuf_reset(&client->batch);  // responses of pipelined requests sended
+    batch_complete(client, status);
+    if (wreq->batch_only) {
+        // current request is not answered yet: its timing and timeout stay untouched
+        wreq->batch_only = false;
+        wreq->client = NULL;  // free write_req
+        if (status != 0) {
+            LOGe("%s: Write error: %s", __func__, uv_strerror(status));
+            close_connection(client);
+        } else if (client->pipeline.status == PS_RESTING && !uv_is_closing((uv_handle_t *)client)) {
+            stream_read_start(client);  // rest of next request
+        }
+        return;
+    }
     if (status != 0) {
         LOGe("%s: Write error: %s", __func__, uv_strerror(status));
         reset_response_preload(client);
@@ -165,6 +481,7 @@ void write_cb(uv_write_t * req, int status)
     reset_response_preload(client);
     if (client->response.chunked == 2) {
         LOGd("%s: last chunk sended!", __func__);
+        done = 1;
         goto fin;
     }
     if (client->response.chunked == 0) {
@@ -176,12 +493,19 @@ void write_cb(uv_write_t * req, int status)
         }
         if (client->response.body_total_written == body_total_size) {
             LOGd("%s: Response body is completely streamed. body_total_size = %lld", __func__, (long long)body_total_size);
+            done = 1;
             goto fin;
         }
     }
     if (client->asgi) {
         goto fin;
     }
+#ifdef __linux__
+    if (client->response.sendfile.remain > 0) {
+        sendfile_pump(client);  // headers sended, transfer file data
+        return;
+    }
+#endif
     client->error = 0;
     PyObject * chunk = wsgi_iterator_get_next_chunk(client, 0);
     if (!chunk) {
@@ -200,6 +524,7 @@ void write_cb(uv_write_t * req, int status)
             return;
         }
         LOGd("%s: end of iterable response body", __func__);
+        done = 1;
         goto fin;
     }
     Py_ssize_t csize = PyBytes_GET_SIZE(chunk);
@@ -221,9 +546,15 @@ fin:
     if (status < 0) {
         close_conn = 1;
     }
+    if (done) {
+        request_complete(client, client->response.body_total_written);
+    }
     if (!client->request.keep_alive || !client->srv->allow_keepalive) {
         close_conn = 1;
     }
+    if (g_srv.drain.active && client->pipeline.status == PS_RESTING) {
+        close_conn = 1;  // server is going to exit (pipelined requests are answered first)
+    }
     if (client->asgi) {
         reset_head_buffer(client);
         if (status < 0) {
@@ -245,6 +576,8 @@ fin:
     if (!close_conn) {
         reset_response_body(client);
         wreq->client = NULL;  // free write_req
+        if (client->request.load_state == LS_WAIT || client->request.load_state >= LS_MSG_END)
+            client_timeout_set(client, CT_KEEP_ALIVE);  // next request not started yet
         if (client->pipeline.status == PS_RESTING) {
             if (!client->asgi)
                 stream_read_start(client);
@@ -255,12 +588,27 @@ fin:
     }
 }
 
+void write_cb(uv_write_t * req, int status)
+{
+    GIL_ENSURE();
+    process_write(req, status);
+    GIL_RELEASE();
+}
+
 int stream_write(client_t * client)
 {
     write_req_t * wreq = &client->response.write_req;
     uv_buf_t * buf = wreq->bufs;
     int total_len = 0;
     int nbufs = 0;
+    if (client->batch.size > 0) {
+        // responses of previous pipelined requests go first
+        buf->base = client->batch.data;
+        buf->len = client->batch.size;
+        buf++;
+        nbufs++;
+        total_len += client->batch.size;
+    }
     if (client->response.headers_size > 0) {
         if (client->response.headers_size != client->head.size)
             return CA_OK; // error ???
@@ -288,11 +636,39 @@ int stream_write(client_t * client)
         nbufs++;
         total_len += 2;
     }
-    stream_read_stop(client);
     LOGi("%s: %d bytes", __func__, total_len);
+    CNT_ADD(&g_srv.stats.bytes_out, total_len);
     wreq->client = client;
-    uv_write((uv_write_t*)wreq, (uv_stream_t*)client, wreq->bufs, nbufs, write_cb);
-    g_srv.num_writes++;
+    buf = wreq->bufs;
+    bool last_part = (client->response.chunked == 2);
+    if (client->response.chunked == 0) {
+        int64_t size = client->response.body_total_written + client->response.body_preloaded_size;
+        last_part = (size == client->response.body_total_size);
+    }
+    if (last_part && !client->asgi) {
+        // fast path: the kernel usually accepts a small response immediately
+        int rc = uv_try_write((uv_stream_t*)client, buf, nbufs);
+        if (rc == total_len) {
+            LOGd("%s: response sended synchronously", __func__);
+            CNT_INC(&g_srv.num_writes);
+            process_write((uv_write_t*)wreq, 0);  // complete response without loop round-trip
+            return CA_OK;
+        }
+        if (rc > 0) {
+            // skip the data already accepted and queue only the remainder
+            size_t skip = (size_t)rc;
+            while (skip >= buf->len) {
+                skip -= buf->len;
+                buf++;
+                nbufs--;
+            }
+            buf->base += skip;
+            buf->len -= skip;
+        }
+    }
+    stream_read_stop(client);
+    uv_write((uv_write_t*)wreq, (uv_stream_t*)client, buf, nbufs, write_cb);
+    CNT_INC(&g_srv.num_writes);
     return CA_OK;
 }
 
@@ -326,6 +702,144 @@ int send_error(client_t * client, int status, const char* error_string)
     return CA_SHUTDOWN;
 }
 
+static
+int send_overload(client_t * client)
+{
+    CNT_INC(&g_srv.overload.shed);
+    CNT_INC(&g_srv.stats.status_5xx);
+    client->alog.status = 503;
+    LOGw("%s: event loop lag %d ms, request rejected", __func__, (int)(g_srv.overload.lag / 1000));
+    if (client->response.write_req.client == NULL) {
+        reset_head_buffer(client);
+        reset_response_body(client);
+        xbuf_add(&client->head, g_srv.overload.response, g_srv.overload.response_len);
+        client->response.headers_size = client->head.size;
+        client->request.keep_alive = 0;
+        stream_write(client);
+    }
+    return CA_SHUTDOWN;
+}
+
+#define OVERLOAD_DECAY  100000  // idle time (us) that halves the lag
+
+static
+void overload_prepare_cb(uv_prepare_t * handle)
+{
+    // loop time is cached at start of iteration: the difference is time of timers and idle callbacks
+    int64_t now = (int64_t)(uv_hrtime() / 1000);
+    g_srv.overload.busy = now - (int64_t)uv_now(g_srv.loop) * 1000;
+    g_srv.overload.poll_start = now;
+}
+
+// Lag decays while loop waits for I/O (idle loop does not run any callbacks)
+static
+int64_t overload_lag(void)
+{
+    if (g_srv.overload.poll_start > 0) {
+        int64_t idle = (int64_t)uv_now(g_srv.loop) * 1000 - g_srv.overload.poll_start;
+        if (idle > 0)
+            g_srv.overload.lag = g_srv.overload.lag * OVERLOAD_DECAY / (OVERLOAD_DECAY + idle);
+        g_srv.overload.poll_start = 0;
+    }
+    return g_srv.overload.lag;
+}
+
+static
+void overload_check_cb(uv_check_t * handle)
+{
+    // loop time is updated after waiting for I/O: the difference is time of I/O callbacks
+    int64_t busy = (int64_t)(uv_hrtime() / 1000) - (int64_t)uv_now(g_srv.loop) * 1000;
+    busy = _max(busy, 0) + _max(g_srv.overload.busy, 0);
+    g_srv.overload.busy = 0;
+    int64_t lag = overload_lag();
+    g_srv.overload.lag = lag + (busy - lag) / 8;  // EWMA
+}
+
+static
+void overload_init()
+{
+    if (g_srv.overload.lag_limit <= 0)
+        return;
+    g_srv.overload.response_len = sprintf(g_srv.overload.response,
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: %d\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n", g_srv.overload.retry_after);
+    uv_prepare_init(g_srv.loop, &g_srv.overload.prepare);
+    uv_prepare_start(&g_srv.overload.prepare, overload_prepare_cb);
+    uv_unref((uv_handle_t *)&g_srv.overload.prepare);
+    uv_check_init(g_srv.loop, &g_srv.overload.check);
+    uv_check_start(&g_srv.overload.check, overload_check_cb);
+    uv_unref((uv_handle_t *)&g_srv.overload.check);
+}
+
+static
+void overload_free()
+{
+    if (g_srv.overload.prepare.type == UV_PREPARE) {
+        uv_prepare_stop(&g_srv.overload.prepare);
+        uv_close((uv_handle_t *)&g_srv.overload.prepare, NULL);
+    }
+    if (g_srv.overload.check.type == UV_CHECK) {
+        uv_check_stop(&g_srv.overload.check);
+        uv_close((uv_handle_t *)&g_srv.overload.check, NULL);
+    }
+}
+
+static
+void client_timeout_cb(timewheel_t * tw, tw_node_t * node)
+{
+    client_t * client = (client_t *)((char *)node - offsetof(client_t, timeout.node));
+    before_loop_callback(client);
+    update_log_prefix(client);
+    int kind = client->timeout.kind;
+    client->timeout.kind = CT_NONE;
+    if (kind == CT_KEEP_ALIVE) {
+        LOGi("%s: keep-alive timeout expired", __func__);
+        close_connection(client);
+        return;
+    }
+    if (kind == CT_HEADERS && client->request.load_state == LS_WAIT) {
+        // peer connected but has not sent a single byte of request: nothing to answer
+        LOGi("%s: header timeout expired (no request)", __func__);
+        close_connection(client);
+        return;
+    }
+    // slow peer: request has not been received in time
+    LOGw("%s: %s timeout expired (load_state = %d)", __func__,
+        (kind == CT_BODY) ? "body" : "header", client->request.load_state);
+    GIL_ENSURE();
+    stream_read_stop(client);
+    send_fatal(client, HTTP_STATUS_REQUEST_TIMEOUT, NULL);
+    shutdown_connection(client);
+    GIL_RELEASE();
+}
+
+void client_timeout_set(client_t * client, int kind)
+{
+    uint64_t timeout = 0;
+    if (kind == CT_KEEP_ALIVE)
+        timeout = (uint64_t)g_srv.keep_alive_timeout * 1000;
+    else if (kind == CT_HEADERS)
+        timeout = (uint64_t)g_srv.header_timeout * 1000;
+    else if (kind == CT_BODY)
+        timeout = (uint64_t)g_srv.body_timeout * 1000;
+
+    if (timeout == 0) {
+        client_timeout_del(client);
+        return;
+    }
+    client->timeout.kind = kind;
+    tw_add(&g_srv.wheel, &client->timeout.node, timeout);
+}
+
+void client_timeout_del(client_t * client)
+{
+    client->timeout.kind = CT_NONE;
+    tw_del(&g_srv.wheel, &client->timeout.node);
+}
+
 int pipeline_close(client_t * client, bool start_reading)
 {
     if (client->pipeline.buf_base) {
@@ -336,10 +850,18 @@ int pipeline_close(client_t * client, bool start_reading)
     if (client->pipeline.status == PS_RESTING)
         return -1;  // pipeline already closed
 
-    g_srv.num_pipeline--;
+    CNT_DEC(&g_srv.num_pipeline);
     if (g_srv.num_pipeline == 0) {
         uv_idle_stop(&g_srv.worker);
     }
+    if (client->pipeline.prev)
+        client->pipeline.prev->pipeline.next = client->pipeline.next;
+    else
+        g_srv.pipeline_list = client->pipeline.next;
+    if (client->pipeline.next)
+        client->pipeline.next->pipeline.prev = client->pipeline.prev;
+    client->pipeline.prev = NULL;
+    client->pipeline.next = NULL;
     LOGi("%s: --------- %s", __func__, (g_srv.num_pipeline == 0) ? "LAST" : "");
     client->pipeline.status = PS_RESTING;
     if (start_reading) {
@@ -350,37 +872,63 @@ int pipeline_close(client_t * client, bool start_reading)
 
 void idle_worker_cb(uv_idle_t * handle)
 {
-    if (g_srv.num_pipeline == 0)
-        return;
-
-    uv_walk(g_srv.loop, pipeline_cb, NULL);
+    client_t * client = g_srv.pipeline_list;
+    while (client) {
+        client_t * next = client->pipeline.next;  // current client may leave the list
+        if (client->response.write_req.client == NULL) {
+            // do not call read_cb until active write
+            read_cb((uv_stream_t *)client, 0, NULL);
+        }
+        client = next;
+    }
 }
 
-void pipeline_cb(uv_handle_t * handle, void * arg)
+static
+int pipeline_resume(client_t * client)
 {
-    if (handle->data != MAGIC_CLIENT)
-        return;
-
-    client_t * client = (client_t *)handle;
-    if (client->response.write_req.client) {
-        // do not call read_cb until active write
-        return;
-    }
+    if (client->pipeline.status == PS_RESTING)
+        return -1;
+    if (client->response.write_req.client)
+        return -2;  // do not parse next request until active write
+    if (uv_is_closing((uv_handle_t *)client))
+        return -3;
     update_log_prefix(client);
-    if (client->pipeline.status == PS_RESTING) {
-        return;
-    }
     llhttp_resume(&client->request.parser);
     ssize_t nread = (size_t)client->pipeline.buf_end - (size_t)client->pipeline.buf_pos;
     uv_buf_t buf;
     buf.base = client->pipeline.buf_pos;
     buf.len = (int)nread;
     LOGi("%s: not parsed data size = %d", __func__, (int)nread);
-    read_cb((uv_stream_t *)client, nread, &buf);
-    // continue read master buffer
+    process_read((uv_stream_t *)client, nread, &buf);
+    return 0;
 }
 
-void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
+static
+bool batch_response(client_t * client)
+{
+    if (client->asgi || client->pipeline.status == PS_RESTING)
+        return false;  // no more requests into master buffer
+    if (!client->request.keep_alive || !client->srv->allow_keepalive)
+        return false;
+    if (client->response.chunked || client->response.body_preloaded_size != client->response.body_total_size)
+        return false;  // response body is not fully loaded
+    int64_t size = client->batch.size + client->head.size + client->response.body_preloaded_size;
+    if (size > max_batch_size)
+        return false;
+    xbuf_add(&client->batch, client->head.data, client->head.size);
+    for (size_t i = 0; i < client->response.body_chunk_num; i++) {
+        PyObject * chunk = client->response.body[i];
+        xbuf_add(&client->batch, PyBytes_AS_STRING(chunk), (int)PyBytes_GET_SIZE(chunk));
+    }
+    batch_defer(client, client->response.body_preloaded_size);
+    reset_head_buffer(client);
+    reset_response_body(client);
+    LOGd("%s: response added to batch (size = %d)", __func__, client->batch.size);
+    return true;
+}
+
+static
+void process_read(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
 {
     int err = 0;
     int act = CA_OK;
@@ -436,7 +984,12 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
                 if (g_srv.num_pipeline == 0) {
                     uv_idle_start(&g_srv.worker, idle_worker_cb);
                 }
-                g_srv.num_pipeline++;
+                CNT_INC(&g_srv.num_pipeline);
+                client->pipeline.prev = NULL;
+                client->pipeline.next = g_srv.pipeline_list;
+                if (g_srv.pipeline_list)
+                    g_srv.pipeline_list->pipeline.prev = client;
+                g_srv.pipeline_list = client;
             }
             if (g_log_level >= LL_DEBUG) {
                 ssize_t s1 = (size_t)pos - (size_t)client->pipeline.buf_base;
@@ -451,6 +1004,7 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
     if (error != HPE_OK) {
         const char * err_pos = llhttp_get_error_pos(parser);
         LOGe("Parse error: %s %s\n", llhttp_errno_name(error), client->request.parser.reason);
+        CNT_INC(&g_srv.stats.parse_errors);
         act = send_fatal(client, HTTP_STATUS_BAD_REQUEST, NULL);
         err = 0;  // skip call send_error
         goto fin;
@@ -491,6 +1045,11 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
         goto fin;
     }
     LOGd("HTTP request successfully parsed (wsgi_input_size = %lld)", (long long)client->request.wsgi_input_size);
+    if (g_srv.overload.lag_limit > 0 && overload_lag() >= (int64_t)g_srv.overload.lag_limit * 1000) {
+        act = send_overload(client);  // app is not called
+        goto fin;
+    }
+    latency_app_begin(client);
     if (client->asgi) {
         err = asgi_call_app(client);
         if (!err)
@@ -498,6 +1057,7 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
         goto fin;
     }
     err = call_wsgi_app(client);
+    latency_app_end(client);
     if (err) {
         goto fin;
     }
@@ -510,11 +1070,12 @@ void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
         goto fin;
     }
     LOGi("Response created! (len = %d+%lld)", client->head.size, (long long)client->response.body_preloaded_size);
-    act = stream_write(client);
+    if (!batch_response(client))
+        act = stream_write(client);
 
 fin:
-    if (buf && buf->base)
-        free_read_buffer(client, buf->base);
+    if (buf && buf->base && buf->base != client->pipeline.buf_base)
+        free_read_buffer(client, buf->base);  // master buffer of pipeline freed by pipeline_close
 
     if (PyErr_Occurred()) {
         if (err == 0)
@@ -545,6 +1106,35 @@ fin:
     }
 }
 
+// Write of gathered responses while next request is not complete
+static
+void batch_flush(client_t * client)
+{
+    client->response.write_req.batch_only = true;
+    stream_write(client);
+}
+
+void read_cb(uv_stream_t * handle, ssize_t nread, const uv_buf_t * buf)
+{
+    client_t * client = (client_t *)handle;
+    GIL_ENSURE();
+    if (buf && nread > 0)
+        CNT_ADD(&g_srv.stats.bytes_in, nread);
+    if (buf)
+        process_read(handle, nread, buf);
+    if (!client->asgi) {
+        // WSGI app completes synchronously: handle all buffered requests in one pass
+        while (pipeline_resume(client) == 0) { }
+        if (client->batch.size > 0 && !client->response.write_req.client) {
+            if (!uv_is_closing((uv_handle_t *)client))
+                batch_flush(client);  // send all gathered responses
+        }
+    } else if (!buf) {
+        pipeline_resume(client);  // called from idle worker
+    }
+    GIL_RELEASE();
+}
+
 void alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
 {
     client_t * client = (client_t *)handle;
@@ -557,58 +1147,62 @@ void alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
         LOGc("%s: __undefined_behavior__ PIPELINE is active", __func__);
         return;
     }
-    int buf_prealloc = 0;
-    xbuf_t * rb = NULL;
-    for (size_t i = 0; i < ARRAY_SIZE(client->rbuf); i++) {
-        xbuf_t * r_buf = &client->rbuf[i];
-        if (r_buf->data == client->buf_read_prealloc)
-            buf_prealloc = 1;  // already used
-
-        if (r_buf->size > 0)
-            continue;  // buffer used!
-
-        if (r_buf->capacity >= read_buffer_size) {
-            // vacant preallocated buffer
-            r_buf->size = read_buffer_size;  // set used flag
-            buf->len = read_buffer_size;
-            buf->base = r_buf->data;
-            buf->base[0] = 0;
-            //LOGi("%s: get preallocated buf %p", __func__, buf->base);
-            return;
-        }
-        if (!rb && r_buf->capacity == 0)
-            rb = r_buf;
-    }
-    if (!rb)  // all read buffers used!
-        return;  // error
-
-    int err = 0;
-    if (buf_prealloc == 0) {
-        err = xbuf_init2(rb, client->buf_read_prealloc, read_buffer_size + 3);
-    } else {
-        err = xbuf_init(rb, NULL, read_buffer_size + 1);
+    if (client->rbuf) {
+        LOGc("%s: __undefined_behavior__ read buffer already used", __func__);
+        return;
     }
-    if (err)
+    client->rbuf = (char *)bufpool_get(&g_srv.rbuf_pool);
+    if (!client->rbuf)
         return;  // error
 
     buf->len = read_buffer_size;
-    buf->base = rb->data;
+    buf->base = client->rbuf;
     buf->base[0] = 0;
-    LOGd("%s: alloc new buffer %p (size = %d)", __func__, buf->base, (int)buf->len);
+    //LOGi("%s: get buffer from pool %p", __func__, buf->base);
 }
 
-void connection_cb(uv_stream_t * server, int status)
+static
+void accept_retry_cb(uv_timer_t * handle)
 {
-    before_loop_callback(NULL);
-    update_log_prefix(NULL);
-    if (status < 0) {
-        LOGe("Connection error %s\n", uv_strerror(status));
+    GIL_ENSURE();
+    accept_resume();
+    GIL_RELEASE();
+}
+
+static
+void accept_fail_cb(uv_handle_t * handle)
+{
+    // connection was not accepted: nothing to count
+    client_free((client_t *)handle);
+}
+
+static
+void accept_client(uv_stream_t * server)
+{
+    LOGi("new connection =================================");
+    client_t * client = client_alloc();
+    if (!client) {
+        // libuv does not poll listen socket until pending connection is accepted
+        LOGc("%s: cannot allocate memory for new client, accepting paused", __func__);
+        g_srv.accept_paused = 1;
+        if (g_srv.accept_timer.type != UV_TIMER)
+            uv_timer_init(g_srv.loop, &g_srv.accept_timer);
+        uv_timer_start(&g_srv.accept_timer, accept_retry_cb, 100, 0);
         return;
     }
-    LOGi("new connection =================================");
-    client_t* client = calloc(1, sizeof(client_t) + g_srv.read_buffer_size + 8);
     client->srv = &g_srv;
 
+    if (g_srv.unix_socket) {
+        uv_pipe_init(g_srv.loop, &client->pipe, 0);
+        client->handle.data = MAGIC_CLIENT;
+        int rc = uv_accept(server, (uv_stream_t*)&client->pipe);
+        if (rc) {
+            uv_close((uv_handle_t*)&client->pipe, accept_fail_cb);
+            return;
+        }
+        goto connected;  // peer of Unix domain socket has no address
+    }
+
     uv_tcp_init(g_srv.loop, &client->handle);
     
     uv_tcp_nodelay(&client->handle, (g_srv.tcp_nodelay > 0) ? 1 : 0);
@@ -629,7 +1223,7 @@ void connection_cb(uv_stream_t * server, int status)
 
     int rc = uv_accept(server, (uv_stream_t*)&client->handle);
     if (rc) {
-        uv_close((uv_handle_t*)&client->handle, close_cb);
+        uv_close((uv_handle_t*)&client->handle, accept_fail_cb);
         return;
     }
     sockaddr_t sock_addr;
@@ -649,15 +1243,200 @@ void connection_cb(uv_stream_t * server, int status)
             sprintf(client->remote_addr, "%s:%d", ip, (int)sock_addr.in4.sin_port);
         }
     }
+connected:
     update_log_prefix(client);
     LOGn("connected =================================");
+    CNT_INC(&g_srv.num_clients);
+    CNT_INC(&g_srv.stats.conn_accepted);
     llhttp_init(&client->request.parser, HTTP_REQUEST, &g_srv.parser_settings);
     client->request.parser.data = client;
+    client_timeout_set(client, (g_srv.header_timeout > 0) ? CT_HEADERS : CT_KEEP_ALIVE);
     stream_read_start(client);
 }
 
+void connection_cb(uv_stream_t * server, int status)
+{
+    before_loop_callback(NULL);
+    update_log_prefix(NULL);
+    if (status < 0) {
+        LOGe("Connection error %s\n", uv_strerror(status));
+        return;
+    }
+    if (g_srv.max_connections > 0 && g_srv.num_clients >= g_srv.max_connections) {
+        // libuv holds the pending connection and stops polling of listen socket until uv_accept
+        LOGw_IF(!g_srv.accept_paused, "%s: limit of connections reached (%d), accepting paused", __func__, g_srv.num_clients);
+        g_srv.accept_paused = 1;
+        return;
+    }
+    accept_client(server);
+}
+
+void accept_resume(void)
+{
+    if (!g_srv.accept_paused || g_srv.drain.active || uv_is_closing((uv_handle_t *)&g_srv))
+        return;
+    if (g_srv.max_connections > 0) {
+        int low_water = g_srv.max_connections - _max(g_srv.max_connections / 10, 1);
+        if (g_srv.num_clients > low_water)
+            return;
+    }
+    g_srv.accept_paused = 0;
+    update_log_prefix(NULL);
+    LOGn("%s: accepting resumed (clients = %d)", __func__, g_srv.num_clients);
+    accept_client((uv_stream_t *)&g_srv);
+    update_log_prefix(NULL);
+}
+
+static
+void close_idle_client_cb(uv_handle_t * handle, void * arg)
+{
+    if (handle->data != MAGIC_CLIENT || uv_is_closing(handle))
+        return;
+    client_t * client = (client_t *)handle;
+    if (client->response.write_req.client || client->pipeline.status != PS_RESTING)
+        return;  // response in progress
+    if (client->request.load_state != LS_WAIT)
+        return;  // request in progress
+    update_log_prefix(client);
+    LOGi("%s: close idle connection", __func__);
+    close_connection(client);
+}
+
+static
+void close_client_cb(uv_handle_t * handle, void * arg)
+{
+    if (handle->data == MAGIC_CLIENT)
+        close_connection((client_t *)handle);
+}
+
+static
+void drain_timeout_cb(uv_timer_t * handle)
+{
+    GIL_ENSURE();
+    update_log_prefix(NULL);
+    LOGw("%s: drain deadline expired, drop %d connections", __func__, g_srv.num_clients);
+    uv_walk(g_srv.loop, close_client_cb, NULL);
+    GIL_RELEASE();
+}
+
+void server_drain(void)
+{
+    if (g_srv.drain.active)
+        return;
+    g_srv.drain.active = 1;
+    update_log_prefix(NULL);
+    LOGn("%s: stop accepting new connections (clients = %d)", __func__, g_srv.num_clients);
+    if (!uv_is_closing((uv_handle_t *)&g_srv))
+        uv_close((uv_handle_t *)&g_srv, NULL);
+    if (g_srv.drain.timeout > 0 && g_srv.num_clients > 0) {
+        uv_timer_init(g_srv.loop, &g_srv.drain.timer);
+        uv_timer_start(&g_srv.drain.timer, drain_timeout_cb, (uint64_t)g_srv.drain.timeout * 1000, 0);
+    }
+    uv_walk(g_srv.loop, close_idle_client_cb, NULL);
+    update_log_prefix(NULL);
+    server_drain_check();
+}
+
+static
+void upgrade_free()
+{
+    if (!g_srv.upgrade.active)
+        return;
+    g_srv.upgrade.active = 0;
+    uv_poll_stop(&g_srv.upgrade.poll);
+    uv_close((uv_handle_t *)&g_srv.upgrade.poll, NULL);
+#ifndef _WIN32
+    close(g_srv.upgrade.fd);
+#endif
+}
+
+#ifndef _WIN32
+static
+void upgrade_ready_cb(uv_poll_t * handle, int status, int events)
+{
+    GIL_ENSURE();
+    update_log_prefix(NULL);
+    // readiness byte is not consumed: every loop of process polls own copy of pipe
+    int avail = 0;
+    if (status < 0 || ioctl(g_srv.upgrade.fd, FIONREAD, &avail) != 0)
+        avail = 0;
+    upgrade_free();
+    PyObject * res = PyObject_CallMethod(g_srv.pysrv, "_upgrade_done", "i", (avail > 0) ? 1 : 0);
+    Py_XDECREF(res);
+    PyErr_Clear();
+    if (avail <= 0) {
+        LOGe("%s: new server generation failed to start", __func__);
+        GIL_RELEASE();
+        return;  // continue serving
+    }
+    LOGn("%s: new server generation is ready", __func__);
+    if (g_srv.unix_socket && g_srv.server_pipe.pipe_fname) {
+        // socket file now belongs to new generation: libuv must not unlink it on close
+        free((void *)g_srv.server_pipe.pipe_fname);
+        g_srv.server_pipe.pipe_fname = NULL;
+    }
+    server_drain();
+    GIL_RELEASE();
+}
+#endif
+
+static
+void server_upgrade()
+{
+    update_log_prefix(NULL);
+    if (g_srv.drain.active || g_srv.upgrade.active)
+        return;
+    if (g_srv.worker_index >= 0) {
+        // worker process: master has already started new generation
+        server_drain();
+        return;
+    }
+#ifdef _WIN32
+    LOGe("%s: server upgrade not supported on this platform", __func__);
+#else
+    // single process: new generation inherits the listen socket
+    int fd = (g_srv.num_threads > 1) ? -1 : (int)g_srv.file_descriptor;
+    if (g_srv.num_threads <= 1 && fd <= 0) {
+        LOGe("%s: listen socket cannot be passed to new generation (fd = %d)", __func__, fd);
+        return;  // continue serving
+    }
+    LOGn("%s: start new server generation (listen fd = %d)", __func__, fd);
+    PyObject * res = PyObject_CallMethod(g_srv.pysrv, "_spawn_generation", "i", fd);
+    int ready_fd = (res) ? (int)PyLong_AsLong(res) : -1;
+    Py_XDECREF(res);
+    if (ready_fd < 0) {
+        LOGe("%s: cannot start new server generation", __func__);
+        if (PyErr_Occurred())
+            PyErr_Print();
+        PyErr_Clear();
+        return;  // continue serving
+    }
+    // listeners are closed only when new generation reports that it accepts connections
+    g_srv.upgrade.fd = ready_fd;
+    uv_poll_init(g_srv.loop, &g_srv.upgrade.poll, ready_fd);
+    uv_poll_start(&g_srv.upgrade.poll, UV_READABLE | UV_DISCONNECT, upgrade_ready_cb);
+    g_srv.upgrade.active = 1;
+#endif
+}
+
 void signal_handler(uv_signal_t * req, int signum)
 {
+#ifdef SIGUSR2
+    if (signum == SIGUSR2) {
+        GIL_ENSURE();
+        server_upgrade();
+        GIL_RELEASE();
+        return;
+    }
+#endif
+#ifndef _WIN32
+    if (signum == SIGTERM) {
+        GIL_ENSURE();
+        server_drain();
+        GIL_RELEASE();
+        return;
+    }
+#endif
     if (signum == SIGINT) {
         uv_stop(g_srv.loop);
         uv_signal_stop(req);
@@ -670,16 +1449,211 @@ void signal_handler(uv_signal_t * req, int signum)
     }
 }
 
+void heartbeat_cb(uv_timer_t * handle)
+{
+    // master process kills the worker if this counter stops changing
+    (*g_srv.heartbeat.counter)++;
+}
+
+static
+int heartbeat_init(PyObject * server)
+{
+    int hr = 0;
+    PyObject * shm = PyObject_GetAttrString(server, "heartbeat_shm");
+    if (!shm) {
+        PyErr_Clear();
+        return 0;  // heartbeat not supported
+    }
+    FIN_IF(shm == Py_None, 0);
+    int64_t index = get_obj_attr_int(server, "worker_index");
+    FIN_IF(index < 0, -1);
+    // each event loop of worker has own slot (a wedged loop should not be hidden by other loops)
+    int64_t num_threads = get_obj_attr_int(server, "num_threads");
+    if (num_threads > 1) {
+        int64_t thread_index = get_obj_attr_int(server, "thread_index");
+        FIN_IF(thread_index < 0 || thread_index >= num_threads, -4);
+        index = index * num_threads + thread_index;
+    }
+    int64_t interval = get_obj_attr_int(server, "heartbeat_interval");
+    g_srv.heartbeat.interval = (interval > 0) ? (int)interval : 1000;
+    hr = PyObject_GetBuffer(shm, &g_srv.heartbeat.view, PyBUF_WRITABLE);
+    FIN_IF(hr, -2);
+    if ((index + 1) * (int64_t)sizeof(uint64_t) > (int64_t)g_srv.heartbeat.view.len) {
+        PyBuffer_Release(&g_srv.heartbeat.view);
+        FIN(-3);
+    }
+    g_srv.heartbeat.counter = (uint64_t *)g_srv.heartbeat.view.buf + index;
+    hr = 0;
+fin:
+    Py_DECREF(shm);
+    LOGe_IF(hr, "%s: cannot attach to shared memory (err = %d)", __func__, hr);
+    return hr;
+}
+
+static
+void heartbeat_free()
+{
+    if (g_srv.heartbeat.timer.type == UV_TIMER) {
+        uv_timer_stop(&g_srv.heartbeat.timer);
+        uv_close((uv_handle_t *)&g_srv.heartbeat.timer, NULL);
+    }
+    if (g_srv.heartbeat.counter) {
+        g_srv.heartbeat.counter = NULL;
+        PyBuffer_Release(&g_srv.heartbeat.view);
+    }
+}
+
+static
+void free_server_instance()
+{
+    server_t * srv = g_srv_ptr;
+    memset(srv, 0, sizeof(server_t));
+    if (srv != &g_srv_main) {
+        g_srv_ptr = &g_srv_main;
+        free(srv);
+    }
+}
+
+static
+void close_handle_cb(uv_handle_t * handle, void * arg)
+{
+    if (!uv_is_closing(handle))
+        uv_close(handle, (handle->data == MAGIC_CLIENT) ? close_cb : NULL);
+}
+
+static
+void set_listen_sockopt()
+{
+#ifndef _WIN32
+    int rc;
+    int fd = (int)g_srv.file_descriptor;
+#ifdef TCP_DEFER_ACCEPT
+    if (g_srv.tcp_defer_accept > 0) {
+        // connection_cb will be called only when request data arrives
+        rc = setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &g_srv.tcp_defer_accept, sizeof(int));
+        LOGw_IF(rc, "%s: cannot set TCP_DEFER_ACCEPT (errno = %d)", __func__, errno);
+    }
+#else
+    LOGw_IF(g_srv.tcp_defer_accept > 0, "%s: TCP_DEFER_ACCEPT not supported on this platform", __func__);
+#endif
+#ifdef TCP_FASTOPEN
+    if (g_srv.tcp_fastopen > 0) {
+        // value is max length of queue of pending TFO requests
+        rc = setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &g_srv.tcp_fastopen, sizeof(int));
+        LOGw_IF(rc, "%s: cannot set TCP_FASTOPEN (errno = %d)", __func__, errno);
+    }
+#else
+    LOGw_IF(g_srv.tcp_fastopen > 0, "%s: TCP_FASTOPEN not supported on this platform", __func__);
+#endif
+#endif
+}
+
+static
+void attach_reuseport_cbpf()
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    // select socket from reuseport group by: incoming_cpu % num_sockets
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)g_srv.reuseport_groups },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog;
+    prog.len = (unsigned short)ARRAY_SIZE(code);
+    prog.filter = code;
+    int rc = setsockopt((int)g_srv.file_descriptor, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    LOGw_IF(rc, "%s: cannot attach BPF program (errno = %d)", __func__, errno);
+    LOGn_IF(!rc, "%s: connections steered by incoming CPU (groups = %d)", __func__, g_srv.reuseport_groups);
+#else
+    LOGw("%s: SO_ATTACH_REUSEPORT_CBPF not supported on this platform", __func__);
+#endif
+}
+
+static
+int open_listen_fd()
+{
+#ifdef _WIN32
+    LOGe("%s: inherited listen socket not supported on this platform", __func__);
+    return -7;
+#else
+    // every loop gets own descriptor: closing of one listener must not affect others
+    int fd = dup(g_srv.listen_fd);
+    if (fd < 0) {
+        LOGe("%s: invalid inherited listen socket %d (errno = %d)", __func__, g_srv.listen_fd, errno);
+        return -7;
+    }
+    int err;
+    if (g_srv.unix_socket) {
+        uv_pipe_init(g_srv.loop, &g_srv.server_pipe, 0);
+        err = uv_pipe_open(&g_srv.server_pipe, fd);
+    } else {
+        uv_tcp_init(g_srv.loop, &g_srv.server);
+        err = uv_tcp_open(&g_srv.server, fd);
+    }
+    if (err) {
+        LOGe("%s: cannot open inherited listen socket %d: %s", __func__, g_srv.listen_fd, uv_strerror(err));
+        close(fd);
+        return -5;
+    }
+    g_srv.file_descriptor = fd;
+    LOGn("%s: use inherited listen socket %d", __func__, g_srv.listen_fd);
+    // loops are inited one by one: the last one drops inherited descriptor (only own copies stay)
+    int64_t thread_index = get_obj_attr_int(g_srv.pysrv, "thread_index");
+    if (g_srv.num_threads <= 1 || thread_index >= g_srv.num_threads - 1) {
+        close(g_srv.listen_fd);
+    }
+    return 0;
+#endif
+}
+
+static
+int bind_unix_socket()
+{
+    const char * path = g_srv.host + 5;  // skip prefix "unix:"
+    uv_pipe_init(g_srv.loop, &g_srv.server_pipe, 0);
+#ifndef _WIN32
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        LOGn("%s: remove stale socket file \"%s\"", __func__, path);
+        unlink(path);
+    }
+#endif
+    int err = uv_pipe_bind(&g_srv.server_pipe, path);
+    if (err) {
+        LOGe("Bind error %s (path = \"%s\")\n", uv_strerror(err), path);
+        return -5;
+    }
+    // socket exists only after bind
+    err = uv_fileno((const uv_handle_t*)&g_srv.server_pipe, &g_srv.file_descriptor);
+    if (err) {
+        LOGe("%s: cannot get descriptor of socket: %s", __func__, uv_strerror(err));
+        g_srv.file_descriptor = (uv_os_fd_t)-1;
+    }
+    return 0;
+}
+
 int init_srv()
 {
     int hr = -1;
     if (g_srv_inited)
         return -1;
 
-    g_srv.loop = uv_default_loop();
+    if (g_srv.thread_mode) {
+        g_srv.loop = (uv_loop_t *)malloc(sizeof(uv_loop_t));
+        FIN_IF(!g_srv.loop, -2);
+        if (uv_loop_init(g_srv.loop) != 0) {
+            free(g_srv.loop);
+            g_srv.loop = NULL;
+            FIN(-3);
+        }
+    } else {
+        g_srv.loop = uv_default_loop();
+    }
 
     configure_parser_settings(&g_srv.parser_settings);
     init_constants();
+    FileWrapper_Init();
+    Environ_Init();
     init_request_dict();
     PyType_Ready(&StartResponse_Type);
     if (g_srv.asgi_app) {
@@ -688,6 +1662,17 @@ int init_srv()
         FIN_IF(hr, hr);
     }
 
+    int err = 0;
+    if (g_srv.listen_fd >= 0) {
+        err = open_listen_fd();
+        FIN_IF(err, err);
+        goto start_listen;
+    }
+    if (g_srv.unix_socket) {
+        err = bind_unix_socket();
+        FIN_IF(err, err);
+        goto start_listen;
+    }
     sockaddr_t addr;
     int tcp_flags = 0;
     if (g_srv.ipv6) {
@@ -704,31 +1689,59 @@ int init_srv()
     int enabled = 1;
 #ifdef _WIN32
     //uv__socket_sockopt((uv_handle_t*)&g_srv.server, SO_REUSEADDR, &enabled);
-#else
-    int so_reuseport = 15;  // SO_REUSEPORT
-    uv__socket_sockopt((uv_handle_t*)&g_srv.server, so_reuseport, &enabled);
+#elif defined(SO_REUSEPORT)
+    uv__socket_sockopt((uv_handle_t*)&g_srv.server, SO_REUSEPORT, &enabled);
 #endif
+    set_listen_sockopt();
 
-    int err = uv_tcp_bind(&g_srv.server, &addr.addr, 0);
+    err = uv_tcp_bind(&g_srv.server, &addr.addr, 0);
     if (err) {
         LOGe("Bind error %s\n", uv_strerror(err));
         hr = -5;
         goto fin;
     }
+start_listen:
     err = uv_listen((uv_stream_t*)&g_srv.server, g_srv.backlog, connection_cb);
     if (err) {
         LOGe("Listen error %s\n", uv_strerror(err));
         hr = -6;
         goto fin;
     }    
+    if (g_srv.reuseport_groups > 1 && g_srv.listen_fd < 0)
+        attach_reuseport_cbpf();
+
     if (g_srv.hook_sigint > 0) {
         uv_signal_init(g_srv.loop, &g_srv.signal);
         uv_signal_start(&g_srv.signal, signal_handler, SIGINT);
     }
+#ifdef SIGUSR2
+    if (g_srv.hook_sigusr2 > 0) {
+        uv_signal_init(g_srv.loop, &g_srv.signal_usr2);
+        uv_signal_start(&g_srv.signal_usr2, signal_handler, SIGUSR2);
+        uv_unref((uv_handle_t *)&g_srv.signal_usr2);
+    }
+#endif
+#ifndef _WIN32
+    if (g_srv.hook_sigterm > 0) {
+        uv_signal_init(g_srv.loop, &g_srv.signal_term);
+        uv_signal_start(&g_srv.signal_term, signal_handler, SIGTERM);
+        uv_unref((uv_handle_t *)&g_srv.signal_term);
+    }
+#endif
     if (1) {  // always enable support HTTP pipelining
         uv_idle_init(g_srv.loop, &g_srv.worker);
         g_srv.worker.data = NULL;
     }
+    tw_init(&g_srv.wheel, g_srv.loop, timewheel_tick, client_timeout_cb);
+    overload_init();
+
+    if (g_srv.heartbeat.counter) {
+        uv_timer_init(g_srv.loop, &g_srv.heartbeat.timer);
+        uv_timer_start(&g_srv.heartbeat.timer, heartbeat_cb, 0, g_srv.heartbeat.interval);
+        uv_unref((uv_handle_t *)&g_srv.heartbeat.timer);
+    }
+    g_srv.next = g_srv_list;
+    g_srv_list = g_srv_ptr;
     g_srv_inited = 1;
     hr = 0;
 
@@ -736,21 +1749,33 @@ fin:
     if (hr) {
         if (g_srv.signal.signal_cb)
             uv_signal_stop(&g_srv.signal);
+        if (g_srv.signal_usr2.signal_cb)
+            uv_signal_stop(&g_srv.signal_usr2);
+        if (g_srv.signal_term.signal_cb)
+            uv_signal_stop(&g_srv.signal_term);
 
         if (g_srv.worker.type == UV_IDLE) {
             uv_idle_stop(&g_srv.worker);
             uv_close((uv_handle_t *)&g_srv.worker, NULL);
         }
+        heartbeat_free();
+        overload_free();
+        tw_close(&g_srv.wheel);
         if (hr <= -5)
             uv_close((uv_handle_t *)&g_srv, NULL);
 
-        if (g_srv.loop)
+        if (g_srv.loop) {
+            if (g_srv.thread_mode)
+                uv_run(g_srv.loop, UV_RUN_NOWAIT);  // complete closing of handles
             uv_loop_close(g_srv.loop);
+            if (g_srv.thread_mode)
+                free(g_srv.loop);
+        }
 
         if (g_srv.aio.asyncio)
             asyncio_free(&g_srv.aio, false);
 
-        memset(&g_srv, 0, sizeof(g_srv));
+        free_server_instance();
     }    
     return hr;
 }
@@ -764,11 +1789,29 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
         PyErr_Format(PyExc_Exception, "server already inited");
         return PyLong_FromLong(-1000);
     }
+    rv = get_obj_attr_int(server, "num_threads");
+    int num_threads = (rv >= 1) ? (int)rv : 1;
+    if (num_threads > 1) {
+#ifdef _WIN32
+        PyErr_Format(PyExc_ValueError, "Option num_threads not supported on this platform");
+        return PyLong_FromLong(-1001);
+#endif
+        // every loop thread gets its own server instance and listen socket (SO_REUSEPORT)
+        server_t * srv = (server_t *)malloc(sizeof(server_t));
+        if (!srv) {
+            PyErr_NoMemory();
+            return PyLong_FromLong(-1002);
+        }
+        g_srv_ptr = srv;
+    }
     memset(&g_srv, 0, sizeof(g_srv));
     g_srv.pysrv = server;
+    g_srv.num_threads = num_threads;
+    g_srv.thread_mode = (num_threads > 1) ? 1 : 0;
 
     int64_t loglevel = get_obj_attr_int(server, "loglevel");
     if (loglevel == LLONG_MIN) {
+        free_server_instance();
         PyErr_Format(PyExc_ValueError, "Option loglevel not defined");
         return PyLong_FromLong(-1010);
     }
@@ -777,11 +1820,17 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
     PyObject * app = PyObject_GetAttrString(server, "app");
     Py_XDECREF(app);
     if (!app) {
+        free_server_instance();
         PyErr_Format(PyExc_ValueError, "Option app not defined");
         return PyLong_FromLong(-1011);
     }
     if (asgi_app_check(app) == true) {
         LOGn("%s: Detect ASGI app", __func__);
+        if (g_srv.thread_mode) {
+            free_server_instance();
+            PyErr_Format(PyExc_ValueError, "Option num_threads not supported for ASGI app");
+            return PyLong_FromLong(-1003);
+        }
         g_srv.asgi_app = app;
     } else {
         LOGn("%s: Detect WSGI app", __func__);
@@ -789,14 +1838,30 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
     }
     const char * host = get_obj_attr_str(server, "host");
     if (!host || strlen(host) >= sizeof(g_srv.host) - 1) {
+        free_server_instance();
         PyErr_Format(PyExc_ValueError, "Option host not defined");
         return PyLong_FromLong(-1012);
     }
     strcpy(g_srv.host, host);
-    g_srv.ipv6 = (strchr(host, ':') == NULL) ? 0 : 1;
+    if (strncmp(host, "unix:", 5) == 0) {
+        if (host[5] == 0) {
+            free_server_instance();
+            PyErr_Format(PyExc_ValueError, "Option host contains empty path of Unix socket");
+            return PyLong_FromLong(-1015);
+        }
+        if (g_srv.thread_mode) {
+            free_server_instance();
+            PyErr_Format(PyExc_ValueError, "Option num_threads not supported for Unix socket");
+            return PyLong_FromLong(-1016);
+        }
+        g_srv.unix_socket = 1;
+    } else {
+        g_srv.ipv6 = (strchr(host, ':') == NULL) ? 0 : 1;
+    }
 
     int64_t port = get_obj_attr_int(server, "port");
     if (port == LLONG_MIN) {
+        free_server_instance();
         PyErr_Format(PyExc_ValueError, "Option port not defined");
         return PyLong_FromLong(-1013);
     }
@@ -804,6 +1869,7 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
 
     int64_t backlog = get_obj_attr_int(server, "backlog");
     if (backlog == LLONG_MIN) {
+        free_server_instance();
         PyErr_Format(PyExc_ValueError, "Option backlog not defined");
         return PyLong_FromLong(-1014);
     }
@@ -812,9 +1878,66 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
     rv = get_obj_attr_int(server, "hook_sigint");
     g_srv.hook_sigint = (rv >= 0) ? (int)rv : 2;
 
+    rv = get_obj_attr_int(server, "hook_sigusr2");
+    g_srv.hook_sigusr2 = (rv >= 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "worker_index");
+    g_srv.worker_index = (rv >= 0) ? (int)rv : -1;
+
+    rv = get_obj_attr_int(server, "header_cache");
+    g_srv.hdr_cache.enabled = (rv == 0) ? 0 : 1;
+
+    rv = get_obj_attr_int(server, "lazy_environ");
+    g_srv.lazy_environ = (rv > 0) ? 1 : 0;
+
+    rv = get_obj_attr_int(server, "max_connections");
+    g_srv.max_connections = (rv > 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "overload_lag");
+    g_srv.overload.lag_limit = (rv > 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "overload_retry_after");
+    g_srv.overload.retry_after = (rv >= 0) ? (int)rv : 1;
+
+    rv = get_obj_attr_int(server, "hook_sigterm");
+    g_srv.hook_sigterm = (rv >= 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "drain_timeout");
+    if (rv == LLONG_MIN) {
+        rv = get_env_int("FASTWSGI_DRAIN_TIMEOUT");
+    }
+    g_srv.drain.timeout = (rv >= 0) ? (int)rv : def_drain_timeout;
+
+    rv = get_obj_attr_int(server, "listen_fd");
+    if (rv == LLONG_MIN) {
+        rv = get_env_int("FASTWSGI_LISTEN_FD");
+    }
+    g_srv.listen_fd = (rv >= 0) ? (int)rv : -1;
+
     rv = get_obj_attr_int(server, "allow_keepalive");
     g_srv.allow_keepalive = (rv == 0) ? 0 : 1;
 
+    rv = get_obj_attr_int(server, "keep_alive_timeout");
+    if (rv == LLONG_MIN) {
+        rv = get_env_int("FASTWSGI_KEEP_ALIVE_TIMEOUT");
+    }
+    g_srv.keep_alive_timeout = (rv > 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "keep_alive_requests");
+    g_srv.keep_alive_requests = (rv > 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "header_timeout");
+    if (rv == LLONG_MIN) {
+        rv = get_env_int("FASTWSGI_HEADER_TIMEOUT");
+    }
+    g_srv.header_timeout = (rv > 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "body_timeout");
+    if (rv == LLONG_MIN) {
+        rv = get_env_int("FASTWSGI_BODY_TIMEOUT");
+    }
+    g_srv.body_timeout = (rv > 0) ? (int)rv : 0;
+
     rv = get_obj_attr_int(server, "add_header_date");
     g_srv.add_header_date = (rv == 0) ? 0 : 1;
 
@@ -847,6 +1970,12 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
     g_srv.read_buffer_size = _min(g_srv.read_buffer_size, MAX_read_buffer_size);
     g_srv.read_buffer_size = _max(g_srv.read_buffer_size, MIN_read_buffer_size);
 
+    rv = get_obj_attr_int(server, "read_buffer_hugepages");
+    bufpool_init(&g_srv.rbuf_pool, g_srv.read_buffer_size + 8, (rv > 0) ? 1 : 0);
+
+    rv = get_obj_attr_int(server, "client_pool_size");
+    g_srv.client_pool.max_size = (rv >= 0) ? (int)rv : def_client_pool_size;
+
     rv = get_obj_attr_int(server, "tcp_nodelay");
     g_srv.tcp_nodelay = (rv >= 0) ? (int)rv : 0;
 
@@ -859,11 +1988,53 @@ PyObject * init_server(PyObject * Py_UNUSED(self), PyObject * server)
     rv = get_obj_attr_int(server, "tcp_recv_buf_size");
     g_srv.tcp_recv_buf_size = (rv >= 0) ? (int)rv : 0;
 
+    rv = get_obj_attr_int(server, "tcp_defer_accept");
+    g_srv.tcp_defer_accept = (rv >= 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "tcp_fastopen");
+    g_srv.tcp_fastopen = (rv >= 0) ? (int)rv : 0;
+
+    rv = get_obj_attr_int(server, "cpu_affinity");
+    if (rv > 0 && num_threads == 1) {
+        // the worker process is pinned to CPUs by fastwsgi.py@_Server._spawn_worker
+        int64_t workers = get_obj_attr_int(server, "num_workers");
+        int64_t index = get_obj_attr_int(server, "worker_index");
+        if (workers > 1 && index >= 0)
+            g_srv.reuseport_groups = (int)workers;
+    }
+
     rv = get_obj_attr_int(server, "nowait");
     g_srv.nowait.mode = (rv <= 0) ? 0 : (int)rv;
 
+    if (heartbeat_init(server) != 0) {
+        free_server_instance();
+        PyErr_Format(PyExc_ValueError, "Option heartbeat_shm has incorrect value");
+        return PyLong_FromLong(-1020);
+    }
+
+    rv = get_obj_attr_int(server, "log_async");
+    if (rv > 0 && log_async_start() == 0)
+        g_srv.log_async = 1;
+
+    const char * access_log = get_obj_attr_str(server, "access_log");
+    if (access_log && access_log[0]) {
+        if (access_log_open(access_log) != 0) {
+            heartbeat_free();
+            if (g_srv.log_async)
+                log_async_stop();
+            free_server_instance();
+            PyErr_Format(PyExc_ValueError, "Cannot open access log \"%s\"", access_log);
+            return PyLong_FromLong(-1021);
+        }
+        g_srv.access_log = 1;
+    }
+
     int hr = init_srv();
     if (hr) {
+        if (g_srv.access_log)
+            access_log_close();
+        if (g_srv.log_async)
+            log_async_stop();
         LOGc("%s: critical error = %d", hr);
         PyErr_Format(PyExc_Exception, "Cannot init TCP server. Error = %d", hr);
     }
@@ -911,6 +2082,11 @@ PyObject * run_server(PyObject * self, PyObject * server)
         res = PyObject_CallFunctionObjArgs(aio->loop.run_forever, NULL);
         Py_XDECREF(res);
     }
+    else if (g_srv.thread_mode) {
+        Py_BEGIN_ALLOW_THREADS
+        uv_run(g_srv.loop, UV_RUN_DEFAULT);
+        Py_END_ALLOW_THREADS
+    }
     else {
         uv_run(g_srv.loop, UV_RUN_DEFAULT);
     }
@@ -970,14 +2146,197 @@ PyObject * close_server(PyObject * Py_UNUSED(self), PyObject * Py_UNUSED(server)
             uv_signal_stop(&g_srv.signal);
             g_srv.signal.signal_cb = NULL;
         }
+        if (g_srv.signal_usr2.signal_cb) {
+            uv_signal_stop(&g_srv.signal_usr2);
+            g_srv.signal_usr2.signal_cb = NULL;
+        }
+        if (g_srv.signal_term.signal_cb) {
+            uv_signal_stop(&g_srv.signal_term);
+            g_srv.signal_term.signal_cb = NULL;
+        }
+        g_srv.drain.active = 0;  // final closing of connections must not stop the loop
+        upgrade_free();
+        if (g_srv.accept_timer.type == UV_TIMER) {
+            uv_timer_stop(&g_srv.accept_timer);
+            uv_close((uv_handle_t *)&g_srv.accept_timer, NULL);
+        }
+        if (g_srv.drain.timer.type == UV_TIMER) {
+            uv_timer_stop(&g_srv.drain.timer);
+            uv_close((uv_handle_t *)&g_srv.drain.timer, NULL);
+        }
         if (g_srv.worker.type == UV_IDLE) {
             uv_idle_stop(&g_srv.worker);
             uv_close((uv_handle_t *)&g_srv.worker, NULL);
         }
-        uv_close((uv_handle_t *)&g_srv, NULL);
+        heartbeat_free();
+        overload_free();
+        tw_close(&g_srv.wheel);
+        if (!uv_is_closing((uv_handle_t *)&g_srv))
+            uv_close((uv_handle_t *)&g_srv, NULL);
+        if (g_srv.thread_mode) {
+            // private loop must be fully closed before releasing its memory
+            uv_walk(g_srv.loop, close_handle_cb, NULL);
+            uv_run(g_srv.loop, UV_RUN_DEFAULT);
+        }
         uv_loop_close(g_srv.loop);
+        if (g_srv.thread_mode)
+            free(g_srv.loop);
+        client_pool_free();
+        bufpool_free(&g_srv.rbuf_pool);
+        hdr_cache_free();
+        if (g_srv.access_log)
+            access_log_close();  // remaining records are written
+        if (g_srv.log_async)
+            log_async_stop();
+        for (server_t ** pp = &g_srv_list; *pp; pp = &(*pp)->next) {
+            if (*pp == g_srv_ptr) {
+                *pp = g_srv.next;
+                break;
+            }
+        }
         g_srv_inited = 0;
-        memset(&g_srv, 0, sizeof(g_srv));
+        free_server_instance();
+    }
+    Py_RETURN_NONE;
+}
+
+static
+void dict_set_uint(PyObject * dict, const char * name, uint64_t value)
+{
+    PyObject * v = PyLong_FromUnsignedLongLong(value);
+    if (v) {
+        PyDict_SetItemString(dict, name, v);
+        Py_DECREF(v);
+    }
+}
+
+PyObject * get_stats(PyObject * Py_UNUSED(self), PyObject * Py_UNUSED(args))
+{
+    // counters of all event loops of current process (each written only by own loop)
+    stats_t st;
+    memset(&st, 0, sizeof(st));
+    uint64_t servers = 0, connections = 0, writes = 0, pipelines = 0, shed = 0;
+    uint64_t pool_hits = 0, pool_misses = 0;
+    uint64_t hc_hits = 0, hc_misses = 0;
+    for (server_t * srv = g_srv_list; srv; srv = srv->next) {
+        servers++;
+        connections += CNT_LOAD(&srv->num_clients);
+        writes += CNT_LOAD(&srv->num_writes);
+        pipelines += CNT_LOAD(&srv->num_pipeline);
+        shed += CNT_LOAD(&srv->overload.shed);
+        pool_hits += CNT_LOAD(&srv->client_pool.hits);
+        pool_misses += CNT_LOAD(&srv->client_pool.misses);
+        hc_hits += CNT_LOAD(&srv->hdr_cache.hits);
+        hc_misses += CNT_LOAD(&srv->hdr_cache.misses);
+        st.conn_accepted += CNT_LOAD(&srv->stats.conn_accepted);
+        st.conn_closed += CNT_LOAD(&srv->stats.conn_closed);
+        st.requests += CNT_LOAD(&srv->stats.requests);
+        st.keepalive_reuse += CNT_LOAD(&srv->stats.keepalive_reuse);
+        st.pipelined += CNT_LOAD(&srv->stats.pipelined);
+        st.bytes_in += CNT_LOAD(&srv->stats.bytes_in);
+        st.bytes_out += CNT_LOAD(&srv->stats.bytes_out);
+        st.parse_errors += CNT_LOAD(&srv->stats.parse_errors);
+        st.status_4xx += CNT_LOAD(&srv->stats.status_4xx);
+        st.status_5xx += CNT_LOAD(&srv->stats.status_5xx);
+    }
+    PyObject * dict = PyDict_New();
+    if (!dict)
+        return NULL;
+    dict_set_uint(dict, "servers", servers);
+    dict_set_uint(dict, "connections", connections);
+    dict_set_uint(dict, "conn_accepted", st.conn_accepted);
+    dict_set_uint(dict, "conn_closed", st.conn_closed);
+    dict_set_uint(dict, "requests", st.requests);
+    dict_set_uint(dict, "keepalive_reuse", st.keepalive_reuse);
+    dict_set_uint(dict, "pipelined", st.pipelined);
+    dict_set_uint(dict, "pipelines_active", pipelines);
+    dict_set_uint(dict, "writes_active", writes);
+    dict_set_uint(dict, "bytes_in", st.bytes_in);
+    dict_set_uint(dict, "bytes_out", st.bytes_out);
+    dict_set_uint(dict, "parse_errors", st.parse_errors);
+    dict_set_uint(dict, "status_4xx", st.status_4xx);
+    dict_set_uint(dict, "status_5xx", st.status_5xx);
+    dict_set_uint(dict, "overload_shed", shed);
+    dict_set_uint(dict, "client_pool_hits", pool_hits);
+    dict_set_uint(dict, "client_pool_misses", pool_misses);
+    dict_set_uint(dict, "header_cache_hits", hc_hits);
+    dict_set_uint(dict, "header_cache_misses", hc_misses);
+    dict_set_uint(dict, "access_log_drops", access_log_drops());
+    dict_set_uint(dict, "log_drops", log_async_drops());
+    return dict;
+}
+
+static
+PyObject * latency_to_dict(const hist_t * h)
+{
+    PyObject * dict = PyDict_New();
+    if (!dict)
+        return NULL;
+    dict_set_uint(dict, "count", h->count);
+    dict_set_uint(dict, "sum", h->sum);
+    dict_set_uint(dict, "max", h->max);
+    dict_set_uint(dict, "p50", hist_percentile(h, 50.0));
+    dict_set_uint(dict, "p90", hist_percentile(h, 90.0));
+    dict_set_uint(dict, "p99", hist_percentile(h, 99.0));
+    dict_set_uint(dict, "p999", hist_percentile(h, 99.9));
+    // non-empty buckets: [ (highest value of bucket, count), ... ]
+    PyObject * list = PyList_New(0);
+    if (list) {
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            if (h->buckets[i] == 0)
+                continue;
+            PyObject * item = Py_BuildValue("(KK)", (unsigned long long)hist_bucket_value(i), (unsigned long long)h->buckets[i]);
+            if (item) {
+                PyList_Append(list, item);
+                Py_DECREF(item);
+            }
+        }
+        PyDict_SetItemString(dict, "buckets", list);
+        Py_DECREF(list);
+    }
+    return dict;
+}
+
+PyObject * get_latency(PyObject * Py_UNUSED(self), PyObject * Py_UNUSED(args))
+{
+    // histograms of all event loops of current process (values in microseconds)
+    hist_t * hist = (hist_t *)calloc(3, sizeof(hist_t));
+    if (!hist)
+        return PyErr_NoMemory();
+    for (server_t * srv = g_srv_list; srv; srv = srv->next) {
+        if (CNT_LOAD_ACQ(&srv->latency.reset_done) != srv->latency.reset_req)
+            continue;  // reset not yet applied by event loop
+        hist_merge(&hist[0], &srv->latency.parse);
+        hist_merge(&hist[1], &srv->latency.app);
+        hist_merge(&hist[2], &srv->latency.ttlb);
+    }
+    const char * names[3] = { "parse", "app", "ttlb" };
+    PyObject * dict = PyDict_New();
+    for (int i = 0; dict && i < 3; i++) {
+        PyObject * item = latency_to_dict(&hist[i]);
+        if (!item) {
+            Py_CLEAR(dict);
+            break;
+        }
+        PyDict_SetItemString(dict, names[i], item);
+        Py_DECREF(item);
+    }
+    free(hist);
+    return dict;
+}
+
+PyObject * reset_latency(PyObject * Py_UNUSED(self), PyObject * Py_UNUSED(args))
+{
+    // histograms of other event loops are cleared by their own threads (see latency_record)
+    for (server_t * srv = g_srv_list; srv; srv = srv->next) {
+        if (srv == g_srv_ptr) {
+            hist_reset(&srv->latency.parse);
+            hist_reset(&srv->latency.app);
+            hist_reset(&srv->latency.ttlb);
+            CNT_SET_REL(&srv->latency.reset_done, srv->latency.reset_req);
+        } else {
+            CNT_SET(&srv->latency.reset_req, srv->latency.reset_req + 1);
+        }
     }
     Py_RETURN_NONE;
 }
@@ -5,6 +5,9 @@
 #include "llhttp.h"
 #include "request.h"
 #include "xbuf.h"
+#include "bufpool.h"
+#include "timewheel.h"
+#include "histogram.h"
 #include "asgi.h"
 
 #define max_preloaded_body_chunks 48
@@ -21,50 +24,177 @@ enum {
     MAX_read_buffer_size = 4 * 1024 * 1024
 };
 
+static const int def_client_pool_size = 64;
+
+static const int timewheel_tick = 100;  // resolution of connection timeouts (ms)
+
+static const int max_batch_size = 64*1024;  // limit for responses of pipelined requests gathered into one write
+
+static const int def_drain_timeout = 30;  // seconds
+
+#define HDR_CACHE_SIZE       16  // number of cached header blocks per server
+#define HDR_CACHE_MAX_ITEMS  8   // max number of headers into cached block
+
+typedef struct {
+    PyObject * status;       // NULL = entry is empty
+    size_t hash;             // hash of content of status and headers (value of "Content-Length" excluded)
+    size_t pending;          // hash of last missed headers (entry is replaced only when they repeat)
+    int num_items;
+    PyObject * items[HDR_CACHE_MAX_ITEMS];  // header tuples (immutable, references held by entry)
+    int status_code;
+    bool date_present;       // app sets own "Date" header
+    int clen_index;          // index of "Content-Length" header (-1 = not specified)
+    int64_t content_length;  // parsed value of "Content-Length" header
+    int size;
+    char * data;             // serialized status line and headers
+} hdr_cache_entry_t;
+
 
 typedef struct {
     uv_write_t req;  // Placement strictly at the beginning of the structure!
     void * client;   // NULL = not sending
-    uv_buf_t bufs[max_preloaded_body_chunks + 3];
+    bool batch_only; // write carries only responses of previous pipelined requests (see batch_flush)
+    uv_buf_t bufs[max_preloaded_body_chunks + 4];
 } write_req_t;
 
+struct client_s;
+
 typedef struct {
-    uv_tcp_t server;  // Placement strictly at the beginning of the structure!
+    uint64_t conn_accepted;    // accepted connections
+    uint64_t conn_closed;      // closed connections
+    uint64_t requests;         // received requests
+    uint64_t keepalive_reuse;  // requests received via already used connection
+    uint64_t pipelined;        // requests parsed from pipeline master buffer
+    uint64_t bytes_in;         // bytes received from sockets
+    uint64_t bytes_out;        // bytes of responses sent into sockets
+    uint64_t parse_errors;     // malformed requests
+    uint64_t status_4xx;       // responses with status 400...499
+    uint64_t status_5xx;       // responses with status 500...599
+} stats_t;
+
+typedef struct server_s {
+    union {
+        uv_tcp_t server;        // Placement strictly at the beginning of the structure!
+        uv_pipe_t server_pipe;  // listener of Unix domain socket
+    };
     PyObject * pysrv; // object fastwsgi.py@_Server
     uv_loop_t* loop;
+    int num_threads;   // number of event loops (threads) into one process
+    int thread_mode;   // 1 = server_t and loop owned by worker thread (GIL released while polling)
     int num_loop_cb;   // the number of callbacks that were called in one loop cycle
     int num_writes;    // the number of write operations
     uv_idle_t worker;  // worker for HTTP pipelining
     int num_pipeline;  // number of active pipelines
+    struct client_s * pipeline_list;  // clients with active pipeline
     uv_os_fd_t file_descriptor;
     llhttp_settings_t parser_settings;
     PyObject* wsgi_app;
     PyObject* asgi_app;
     int ipv6;
-    char host[64];
+    int unix_socket;   // 1 = listen Unix domain socket (host = "unix:/path")
+    char host[128];
     int port;
     int backlog;
     int hook_sigint;   // 0 - ignore SIGINT, 1 - handle SIGINT, 2 - handle SIGINT with halt prog
     uv_signal_t signal;
+    int hook_sigusr2;  // 0 - ignore SIGUSR2, 1 - graceful upgrade (start new server generation and drain)
+    uv_signal_t signal_usr2;
+    int worker_index;  // index of worker process (-1 = single process)
+    int hook_sigterm;  // 0 - ignore SIGTERM, 1 - graceful drain on SIGTERM
+    uv_signal_t signal_term;
+    int listen_fd;     // inherited listen socket (-1 = create new socket)
+    int num_clients;   // number of connected clients
+    int max_connections;  // 0 = unlimited; 1...N = limit of connected clients (accepting paused on limit)
+    int accept_paused;    // 1 = pending connection is not accepted until clients disconnect
+    uv_timer_t accept_timer;  // retry of accepting after allocation failure
+    struct {
+        int active;    // 1 = listen socket closed, waiting for completion of active connections
+        int timeout;   // deadline for completion of active connections in seconds (0 = unlimited)
+        uv_timer_t timer;
+    } drain;
+    struct {
+        int active;    // 1 = waiting for readiness of new server generation
+        int fd;        // read end of readiness pipe of new generation
+        uv_poll_t poll;
+    } upgrade;
     int allow_keepalive;
+    int keep_alive_timeout;   // idle timeout of keep-alive connection in seconds (0 = unlimited)
+    int keep_alive_requests;  // max number of requests per connection (0 = unlimited)
+    int header_timeout;       // deadline for receiving request headers in seconds (0 = unlimited)
+    int body_timeout;         // deadline for receiving request body in seconds (0 = unlimited)
+    timewheel_t wheel;        // timeouts of all connections
     int add_header_date;
     int add_header_server;
     char header_server[80];
     size_t read_buffer_size;
+    bufpool_t rbuf_pool;   // shared read buffers (held by connection only while read_cb is processed)
     uint64_t max_content_length;
     size_t max_chunk_size;
+    int access_log;        // 1 = requests are written into access log (see accesslog.h)
+    int log_async;         // 1 = log records are written by background thread (see logx.h)
     int tcp_nodelay;       // 0 = Nagle's algo enabled; 1 = Nagle's algo disabled;
     int tcp_keepalive;     // negative = disabled; 0 = system default; 1...N = timeout in seconds
     int tcp_send_buf_size; // 0 = system default; 1...N = size in bytes
     int tcp_recv_buf_size; // 0 = system default; 1...N = size in bytes
+    int tcp_defer_accept;  // 0 = disabled; 1...N = timeout in seconds for waiting of request data
+    int tcp_fastopen;      // 0 = disabled; 1...N = queue length of pending TFO requests
+    int reuseport_groups;  // 0 = disabled; 2...N = number of workers for steering connections by incoming CPU
     struct {
         int mode;          // 0 - disabled, 1 - nowait active, 2 - nowait with wait disconnect all peers
         int base_handles;  // number of base handles (listen socket + signal)
     } nowait;
+    struct {
+        uv_timer_t timer;
+        int interval;      // timer interval in milliseconds
+        Py_buffer view;    // shared memory of master process (fastwsgi.py@_Server.heartbeat_shm)
+        volatile uint64_t * counter;  // slot of this worker (NULL = heartbeat disabled)
+    } heartbeat;
+    struct {
+        int lag_limit;     // 0 = disabled; 1...N = event loop lag (ms) above which new requests get 503
+        int retry_after;   // value of "Retry-After" header (seconds)
+        uv_prepare_t prepare;
+        uv_check_t check;
+        int64_t busy;      // time (us) spent into callbacks before poll phase of current loop iteration
+        int64_t lag;       // smoothed duration (us) of callbacks processing per loop iteration
+        int64_t poll_start;  // time (us) when loop started waiting for I/O (0 = not waiting)
+        uint64_t shed;     // number of requests rejected with 503
+        char response[160];  // pre-serialized 503 response
+        int response_len;
+    } overload;
+    struct {
+        int enabled;
+        uint64_t hits;
+        uint64_t misses;
+        hdr_cache_entry_t entries[HDR_CACHE_SIZE];
+    } hdr_cache;           // serialized headers of WSGI responses (keyed by content of start_response args)
+    int lazy_environ;      // 1 = values of request headers created on first access (see environ.c)
+    struct {
+        void * head;       // free-list of recycled client_t blocks
+        int size;          // number of blocks into free-list
+        int max_size;      // 0 = pool disabled
+        uint64_t hits;     // connections served by recycled block
+        uint64_t misses;   // connections that required new allocation
+    } client_pool;
+    stats_t stats;
+    struct {
+        hist_t parse;      // from first byte of request to call of app (us)
+        hist_t app;        // duration of app call (us)
+        hist_t ttlb;       // from first byte of request to last byte of response (us)
+        uint64_t reset_req;   // resets requested by reset_latency (written under GIL)
+        uint64_t reset_done;  // resets applied by own event loop
+    } latency;
+    struct server_s * next;  // placement into list of running servers (see get_stats)
     int exit_code;
     asyncio_t aio;
 } server_t;
 
+typedef enum {
+    CT_NONE        = 0,
+    CT_KEEP_ALIVE  = 1,  // waiting for next request on idle connection
+    CT_HEADERS     = 2,  // waiting for end of request headers
+    CT_BODY        = 3   // waiting for end of request body
+} ct_kind_t;
+
 typedef enum {
     PS_RESTING    = 0,  // pipeline not used
     PS_ACTIVE     = 1   // pipeline active for reading from master buffer
@@ -80,17 +210,33 @@ typedef enum {
     LS_OK              = 6   // request loaded fully
 } load_state_t;
 
-typedef struct {
-    uv_tcp_t handle;     // peer connection. Placement strictly at the beginning of the structure! 
+typedef struct client_s {
+    union {
+        uv_tcp_t handle;     // peer connection. Placement strictly at the beginning of the structure! 
+        uv_pipe_t pipe;      // peer connection via Unix domain socket
+    };
     server_t * srv;
     char remote_addr[64];
-    xbuf_t rbuf[2];      // buffers for reading from socket
+    struct {
+        tw_node_t node;      // placement into g_srv.wheel
+        int kind;            // type of armed timeout (ct_kind_t)
+    } timeout;
+    int num_requests;    // number of requests received via this connection
+    struct {
+        uint64_t begin;      // start of current request (us, 0 = not measured)
+        uint64_t app_start;  // call of app (us)
+    } timing;
+    char * rbuf;         // buffer for reading from socket (taken from g_srv.rbuf_pool)
     struct {
         pl_status_t status;  // pipeline status
         char * buf_base;     // master buffer with pipeline-requests
         char * buf_pos;      // parser cursor position (into master buf)
         char * buf_end;
+        struct client_s * prev;  // placement into g_srv.pipeline_list
+        struct client_s * next;
     } pipeline;
+    xbuf_t batch;        // responses of pipelined requests waiting for a single write
+    xbuf_t batch_done;   // records of responses into batch (completed by write of batch)
     asgi_t * asgi;       // ASGI 3.0 implementation
     struct {
         int load_state;
@@ -107,6 +253,12 @@ typedef struct {
         llhttp_t parser;
         bool parser_locked;
     } request;
+    struct {
+        int status;          // status of response
+        int method;          // request method (llhttp_method_t)
+        int http_minor;
+        int path_len;        // size of alog_path
+    } alog;              // fields of access log record
     int error;    // error code on process request and response
     xbuf_t head;  // dynamic buffer for request and response headers data
     StartResponse * start_response;
@@ -121,26 +273,48 @@ typedef struct {
         int64_t body_total_size;
         int64_t body_total_written;
         int chunked;    // 1 = chunked sending; 2 = last chunk send
+        struct {
+            int fd;              // descriptor of file wrapped by wsgi.file_wrapper
+            int64_t offset;      // current position into file
+            int64_t remain;      // 0 = sendfile not used
+            void * poll;         // waiting for writable socket (sf_poll_t)
+        } sendfile;
         write_req_t write_req;
+        struct {
+            PyObject * headers;  // list of headers that was looked up (NULL = no lookup)
+            hdr_cache_entry_t * entry;  // NULL = headers are not placed into cache
+            bool hit;
+        } hdr_cache;
     } response;
     // preallocated buffers
     char buf_head_prealloc[2*1024];
-    char buf_read_prealloc[1];
+    char alog_path[256];  // request target for access log (used only if access log enabled)
 } client_t;
 
-extern server_t g_srv;
+// Each event loop thread has its own server instance
+extern THREAD_LOCAL server_t * g_srv_ptr;
+#define g_srv (*g_srv_ptr)
 
 PyObject * init_server(PyObject * self, PyObject * server);
 PyObject * change_setting(PyObject * self, PyObject * args);
 PyObject * run_server(PyObject * self, PyObject * server);
 PyObject * run_nowait(PyObject * self, PyObject * server);
 PyObject * close_server(PyObject * self, PyObject * server);
+PyObject * get_stats(PyObject * self, PyObject * args);
+PyObject * get_latency(PyObject * self, PyObject * args);
+PyObject * reset_latency(PyObject * self, PyObject * args);
 
 int x_send_status(client_t * client, int status);
 int stream_write(client_t * client);
 int stream_read_start(client_t * client);
 int stream_read_stop(client_t * client);
 void close_connection(client_t * client);
+void server_drain(void);
+void accept_resume(void);
+int sendfile_prepare(client_t * client, PyObject * wsgi_body);
+void sendfile_reset(client_t * client);
+void client_timeout_set(client_t * client, int kind);
+void client_timeout_del(client_t * client);
 
 // ----------- functions from request.c ----------------------------
 
@@ -148,6 +322,7 @@ void reset_head_buffer(client_t * client);
 void free_start_response(client_t * client);
 void reset_response_preload(client_t * client);
 void reset_response_body(client_t * client);
+void hdr_cache_free(void);
 
 int call_wsgi_app(client_t * client);
 int process_wsgi_response(client_t * client);
@@ -166,11 +341,49 @@ PyObject* wsgi_iterator_get_next_chunk(client_t * client, int outpyerr);
 
 // -----------------------------------------------------------------
 
+// In thread mode the loop runs without GIL, so callbacks that touch Python objects must take it
+#define GIL_ENSURE()   PyGILState_STATE _gil_state = (g_srv.thread_mode) ? PyGILState_Ensure() : PyGILState_UNLOCKED
+#define GIL_RELEASE()  if (g_srv.thread_mode) PyGILState_Release(_gil_state)
+
 inline void before_loop_callback(void * _client)
 {
     g_srv.num_loop_cb++;
 }
 
+static INLINE uint64_t latency_now()
+{
+    return uv_hrtime() / 1000;
+}
+
+// Histograms are cleared only by own event loop (see reset_latency)
+static INLINE void latency_record(hist_t * h, uint64_t value)
+{
+    uint64_t req = CNT_LOAD(&g_srv.latency.reset_req);
+    if (req != g_srv.latency.reset_done) {
+        hist_reset(&g_srv.latency.parse);
+        hist_reset(&g_srv.latency.app);
+        hist_reset(&g_srv.latency.ttlb);
+        CNT_SET_REL(&g_srv.latency.reset_done, req);
+    }
+    hist_record(h, value);
+}
+
+static INLINE void latency_app_begin(client_t * client)
+{
+    if (client->timing.begin == 0)
+        return;
+    client->timing.app_start = latency_now();
+    latency_record(&g_srv.latency.parse, client->timing.app_start - client->timing.begin);
+}
+
+static INLINE void latency_app_end(client_t * client)
+{
+    if (client->timing.app_start == 0)
+        return;
+    latency_record(&g_srv.latency.app, latency_now() - client->timing.app_start);
+    client->timing.app_start = 0;
+}
+
 inline void update_log_prefix(void * _client)
 {
     client_t * client = (client_t *)_client;
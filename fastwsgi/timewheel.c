@@ -0,0 +1,120 @@
+#include "timewheel.h"
+
+INLINE
+static
+void tw_list_init(tw_node_t * head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+INLINE
+static
+void tw_list_insert(tw_node_t * head, tw_node_t * node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+INLINE
+static
+void tw_list_remove(tw_node_t * node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+static
+void tw_timer_cb(uv_timer_t * handle)
+{
+    timewheel_t * tw = (timewheel_t *)handle;
+    uint64_t now = uv_now(handle->loop) / tw->tick;
+    uint64_t last = now;
+    if (now - tw->current > TW_NUM_SLOTS)
+        last = tw->current + TW_NUM_SLOTS;  // all slots will be checked once
+    tw_node_t pending;
+    while (tw->current < last && tw->count > 0) {
+        tw->current++;
+        tw_node_t * slot = &tw->slots[tw->current % TW_NUM_SLOTS];
+        if (slot->next == slot)
+            continue;
+        // move the slot list aside: callbacks may arm or disarm any node
+        pending = *slot;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        tw_list_init(slot);
+        while (pending.next != &pending) {
+            tw_node_t * node = pending.next;
+            tw_list_remove(node);
+            if (node->expire > now) {
+                tw_list_insert(slot, node);  // expires on one of the next rounds
+                continue;
+            }
+            tw->count--;
+            tw->expire_cb(tw, node);
+        }
+    }
+    tw->current = now;
+    if (tw->count == 0)
+        uv_timer_stop(&tw->timer);
+}
+
+int tw_init(timewheel_t * tw, uv_loop_t * loop, int tick, tw_expire_cb expire_cb)
+{
+    memset(tw, 0, sizeof(timewheel_t));
+    tw->tick = (tick > 0) ? (uint64_t)tick : 1;
+    tw->expire_cb = expire_cb;
+    for (size_t i = 0; i < TW_NUM_SLOTS; i++)
+        tw_list_init(&tw->slots[i]);
+
+    int rc = uv_timer_init(loop, &tw->timer);
+    if (rc)
+        return rc;
+    uv_unref((uv_handle_t *)&tw->timer);  // the wheel should not keep loop alive
+    return 0;
+}
+
+void tw_close(timewheel_t * tw)
+{
+    if (tw->timer.type != UV_TIMER)
+        return;
+    uv_timer_stop(&tw->timer);
+    uv_close((uv_handle_t *)&tw->timer, NULL);
+    for (size_t i = 0; i < TW_NUM_SLOTS; i++) {
+        tw_node_t * slot = &tw->slots[i];
+        while (slot->next != slot)
+            tw_list_remove(slot->next);
+    }
+    tw->count = 0;
+}
+
+void tw_add(timewheel_t * tw, tw_node_t * node, uint64_t timeout)
+{
+    if (node->next)
+        tw_del(tw, node);
+    uv_loop_t * loop = tw->timer.loop;
+    if (tw->count == 0) {
+        tw->current = uv_now(loop) / tw->tick;
+        uv_timer_start(&tw->timer, tw_timer_cb, tw->tick, tw->tick);
+    }
+    // round up: node never expires earlier than requested
+    node->expire = (uv_now(loop) + timeout + tw->tick - 1) / tw->tick;
+    if (node->expire <= tw->current)
+        node->expire = tw->current + 1;
+    tw_list_insert(&tw->slots[node->expire % TW_NUM_SLOTS], node);
+    tw->count++;
+}
+
+void tw_del(timewheel_t * tw, tw_node_t * node)
+{
+    if (!node->next)
+        return;  // not armed
+    tw_list_remove(node);
+    tw->count--;
+    if (tw->count == 0)
+        uv_timer_stop(&tw->timer);
+}
@@ -0,0 +1,42 @@
+#ifndef FASTWSGI_TIMEWHEEL_H_
+#define FASTWSGI_TIMEWHEEL_H_
+
+#include "common.h"
+
+// Hashed timing wheel: one uv_timer_t serves timeouts of all connections.
+// Expiration precision is one tick.
+
+#define TW_NUM_SLOTS  512
+
+typedef struct tw_node_s {
+    struct tw_node_s * next;  // NULL = node not armed
+    struct tw_node_s * prev;
+    uint64_t expire;          // expiration tick
+} tw_node_t;
+
+typedef struct timewheel_s timewheel_t;
+
+typedef void (*tw_expire_cb)(timewheel_t * tw, tw_node_t * node);
+
+struct timewheel_s {
+    uv_timer_t timer;
+    uint64_t tick;            // tick duration in milliseconds
+    uint64_t current;         // last processed tick
+    int count;                // number of armed nodes
+    tw_expire_cb expire_cb;
+    tw_node_t slots[TW_NUM_SLOTS];  // heads of circular lists
+};
+
+int tw_init(timewheel_t * tw, uv_loop_t * loop, int tick, tw_expire_cb expire_cb);
+void tw_close(timewheel_t * tw);
+void tw_add(timewheel_t * tw, tw_node_t * node, uint64_t timeout);
+void tw_del(timewheel_t * tw, tw_node_t * node);
+
+INLINE
+static
+bool tw_is_armed(tw_node_t * node)
+{
+    return node->next != NULL;
+}
+
+#endif
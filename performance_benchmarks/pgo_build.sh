@@ -0,0 +1,21 @@
+#!/bin/sh
+# Release build of fastwsgi with LTO and profile-guided optimization.
+# Usage (from repository root): sh performance_benchmarks/pgo_build.sh
+
+set -e
+export FASTWSGI_BUILD=release
+export FASTWSGI_PGO_DIR="$(pwd)/build/pgo"
+
+rm -rf build "$FASTWSGI_PGO_DIR"
+
+# 1. instrumented build
+FASTWSGI_PGO=generate python3 setup.py build_ext --inplace --force
+
+# 2. training run
+python3 performance_benchmarks/pgo_train.py
+
+# 3. optimized build
+rm -rf build/temp*
+FASTWSGI_PGO=use python3 setup.py build_ext --inplace --force
+
+echo "Done. Compare with: cd performance_benchmarks/benchmarks && sh benchmark_fastwsgi_wsgi.sh"
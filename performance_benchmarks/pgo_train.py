@@ -0,0 +1,126 @@
+# Training workload for profile-guided build of fastwsgi (see pgo_build.sh).
+# Starts servers/fastwsgi_wsgi.py and loads it wrk-style: N connections with keep-alive,
+# part of them with pipelined requests, plus requests with body and rare errors.
+
+import os
+import sys
+import time
+import signal
+import socket
+import threading
+import subprocess
+
+HOST = "127.0.0.1"
+PORT = 5000
+DURATION = float(os.getenv("PGO_DURATION", "20"))
+CONNECTIONS = int(os.getenv("PGO_CONNECTIONS", "32"))
+
+SERVER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "servers", "fastwsgi_wsgi.py")
+
+REQ_GET = (
+    b"GET / HTTP/1.1\r\n"
+    b"Host: localhost:5000\r\n"
+    b"User-Agent: pgo-train\r\n"
+    b"Accept: */*\r\n"
+    b"Accept-Encoding: gzip, deflate\r\n"
+    b"Connection: keep-alive\r\n"
+    b"\r\n"
+)
+REQ_POST = (
+    b"POST /form?a=1&b=2 HTTP/1.1\r\n"
+    b"Host: localhost:5000\r\n"
+    b"Content-Type: application/x-www-form-urlencoded\r\n"
+    b"Content-Length: 27\r\n"
+    b"\r\n"
+    b"name=fastwsgi&value=1234567"
+)
+REQ_CHUNKED = (
+    b"POST /upload HTTP/1.1\r\n"
+    b"Host: localhost:5000\r\n"
+    b"Transfer-Encoding: chunked\r\n"
+    b"\r\n"
+    b"5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"
+)
+REQ_BAD = b"GET / HTTP/1.1\r\nHost localhost\r\n\r\n"
+
+
+def wait_server(timeout = 10.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((HOST, PORT), timeout = 1.0).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def read_responses(sock, count):
+    # every response of servers/fastwsgi_wsgi.py ends with its body
+    data = b""
+    while data.count(b"Hello, World!") < count:
+        chunk = sock.recv(65536)
+        if not chunk:
+            return False
+        data += chunk
+    return True
+
+
+def client(idx, stats, stop):
+    pipeline = 1 if idx % 4 else 16   # every 4th connection pipelines requests
+    while not stop.is_set():
+        try:
+            sock = socket.create_connection((HOST, PORT))
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            for n in range(1000):
+                if stop.is_set():
+                    break
+                if n % 50 == 49:
+                    sock.sendall(REQ_POST + REQ_CHUNKED)
+                    count = 2
+                else:
+                    sock.sendall(REQ_GET * pipeline)
+                    count = pipeline
+                if not read_responses(sock, count):
+                    break
+                stats[idx] += count
+            sock.close()
+            if idx == 0:
+                # malformed request: 400 and disconnect
+                sock = socket.create_connection((HOST, PORT))
+                sock.sendall(REQ_BAD)
+                sock.recv(65536)
+                sock.close()
+        except OSError:
+            time.sleep(0.05)
+
+
+def main():
+    env = os.environ.copy()
+    proc = subprocess.Popen([ sys.executable, SERVER ], env = env)
+    try:
+        if not wait_server():
+            print("Server not started")
+            return 1
+        stats = [ 0 ] * CONNECTIONS
+        stop = threading.Event()
+        threads = [ threading.Thread(target = client, args = (i, stats, stop), daemon = True) for i in range(CONNECTIONS) ]
+        start = time.monotonic()
+        for th in threads:
+            th.start()
+        time.sleep(DURATION)
+        stop.set()
+        for th in threads:
+            th.join(5.0)
+        elapsed = time.monotonic() - start
+        total = sum(stats)
+        print(f"Training requests: {total} ({total / elapsed:.0f} req/s)")
+    finally:
+        # SIGINT: server exits via exit() and profile data is written
+        proc.send_signal(signal.SIGINT)
+        proc.wait(10)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -36,6 +36,12 @@ def get_compiler_version(exe_name):
 
 current_compiler = os.getenv('CC', "")
 
+# FASTWSGI_BUILD=release: compile out debug logging and link libuv, llhttp and fastwsgi as one LTO unit
+BUILD_PROFILE = os.getenv('FASTWSGI_BUILD', "debug").lower()
+# FASTWSGI_PGO=generate|use: profile-guided optimization (see performance_benchmarks/pgo_build.sh)
+PGO_MODE = os.getenv('FASTWSGI_PGO', "").lower()
+PGO_DIR = os.path.abspath(os.getenv('FASTWSGI_PGO_DIR', os.path.join("build", "pgo")))
+
 # Forced use clang compiler, if installed
 if platform.system() == "Linux" and current_compiler == "":
     for cc_ver in range(40, 7, -1):
@@ -78,21 +84,52 @@ class build_all(build_ext):
             if c_ver_major:
                 compiler_ver_major = c_ver_major
 
+        release = (BUILD_PROFILE == "release")
+        print("Build profile: {}{}".format(BUILD_PROFILE, " (PGO: {})".format(PGO_MODE) if PGO_MODE else ""))
         for ext in self.extensions:
             if ext == module:
                 if compiler_type == 'msvc':
                     ext.extra_compile_args = [ '/Oi', '/Oy-', '/W3', '/WX-', '/Gd', '/GS' ]
                     ext.extra_compile_args += [ '/Zc:forScope', '/Zc:inline', '/fp:precise', '/analyze-' ]
+                    if release:
+                        ext.extra_compile_args += [ '/GL' ]
+                        ext.extra_link_args = [ '/LTCG' ]
                 else:
-                    ext.extra_compile_args = [ "-O3", "-fno-strict-aliasing", "-fcommon", "-g", "-Wall" ]
+                    ext.extra_compile_args = [ "-O3", "-fno-strict-aliasing", "-fcommon", "-Wall" ]
                     ext.extra_compile_args += [ "-Wno-unused-function", "-Wno-unused-variable" ]
                     if compiler.startswith("gcc") and compiler_ver_major >= 8:
                         ext.extra_compile_args += [ "-Wno-unused-but-set-variable" ]
                     if compiler.startswith("clang") and compiler_ver_major >= 13:
                         ext.extra_compile_args += [ "-Wno-unused-but-set-variable" ]
+                    if release:
+                        ext.extra_compile_args += [ "-flto" ]
+                        ext.extra_link_args = [ "-O3", "-flto" ]
+                    else:
+                        ext.extra_compile_args += [ "-g" ]
+                    pgo_args = self.get_pgo_args(compiler)
+                    ext.extra_compile_args += pgo_args
+                    ext.extra_link_args = getattr(ext, 'extra_link_args', [ ]) + pgo_args
+                if release:
+                    ext.define_macros += [ ('FASTWSGI_RELEASE', '1'), ('MAX_LOG_LEVEL', '5') ]  # up to LL_NOTICE
         
         build_ext.build_extensions(self)
 
+    def get_pgo_args(self, compiler):
+        if PGO_MODE == "generate":
+            os.makedirs(PGO_DIR, exist_ok=True)
+            return [ "-fprofile-generate={}".format(PGO_DIR) ]
+        if PGO_MODE == "use":
+            if compiler.startswith("clang"):
+                # clang reads merged profile only
+                profdata = os.path.join(PGO_DIR, "default.profdata")
+                raw = glob.glob(os.path.join(PGO_DIR, "*.profraw"))
+                llvm_profdata = compiler.replace("clang", "llvm-profdata", 1)
+                if raw:
+                    subprocess.run([ llvm_profdata, "merge", "-output={}".format(profdata) ] + raw, check=True)
+                return [ "-fprofile-use={}".format(profdata), "-Wno-profile-instr-unprofiled" ]
+            return [ "-fprofile-use={}".format(PGO_DIR), "-fprofile-correction", "-Wno-missing-profile" ]
+        return [ ]
+
 
 with open("README.md", "r", encoding="utf-8") as read_me:
     long_description = read_me.read()
@@ -1,3 +1,7 @@
+import json
+import time
+import fastwsgi
+
 def _no_response(environ, start_response):
     start_response("200 OK", [])
     return []
@@ -6,9 +10,83 @@ def _invalid_return_type(environ, start_response):
     start_response("200 OK", [])
     return "non-bytestring"
 
+def _file_wrapper(environ, start_response):
+    f = open(__file__, "rb")
+    f.seek(10)
+    start_response("200 OK", [("Content-Type", "text/plain")])
+    return environ["wsgi.file_wrapper"](f, 4096)
+
+def _stats(environ, start_response):
+    body = json.dumps(fastwsgi.get_stats()).encode()
+    start_response("200 OK", [("Content-Type", "application/json")])
+    return [body]
+
+def _latency(environ, start_response):
+    if environ["QUERY_STRING"] == "reset":
+        fastwsgi.reset_latency()
+    ttlb = fastwsgi.get_latency()["ttlb"]
+    body = json.dumps({"count": ttlb["count"], "max": ttlb["max"]}).encode()
+    start_response("200 OK", [("Content-Type", "application/json")])
+    return [body]
+
+def _cached_headers(environ, start_response):
+    start_response("200 OK", [("Content-Type", "text/plain"), ("X-Cached", "yes")])
+    return [b"cached"]
+
+def _environ(environ, start_response):
+    if environ["QUERY_STRING"] == "materialize":
+        len(environ)  # all request headers are placed into dict before access by key
+    result = {
+        "type": type(environ).__name__,
+        "get": environ.get("HTTP_X_TEST"),
+        "get_default": environ.get("HTTP_X_MISSING", "default"),
+        "contains": "HTTP_X_TEST" in environ,
+        "contains_missing": "HTTP_X_MISSING" in environ,
+        "getitem": environ["HTTP_X_TEST"],
+        "pop": environ.pop("HTTP_X_POP", None),
+        "contains_popped": "HTTP_X_POP" in environ,
+        "dup": environ.get("HTTP_X_DUP"),
+        "contains_bad": "HTTP_X_BAD" in environ,
+    }
+    try:
+        environ["HTTP_X_MISSING"]
+        result["key_error"] = False
+    except KeyError:
+        result["key_error"] = True
+    keys = list(environ)
+    result["keys"] = sorted(key for key in keys if key.startswith("HTTP_X_"))
+    result["len"] = [len(environ), len(keys), len(dict(environ))]
+    result["dict_dup"] = dict(environ).get("HTTP_X_DUP")
+    body = json.dumps(result).encode()
+    start_response("200 OK", [("Content-Type", "application/json")])
+    return [body]
+
+def _fresh_headers(environ, start_response):
+    # new list, tuples and strings for every response (as frameworks do)
+    start_response("200 OK", [("Content-Type", "".join(["text/", "plain"])), ("X-Fresh", "".join(["y", "es"]))])
+    return [b"fresh"]
+
+def _varying_length(environ, start_response):
+    body = b"x" * int(environ["QUERY_STRING"])
+    start_response("200 OK", [("Content-Type", "text/plain"), ("Content-Length", str(len(body)))])
+    return [body]
+
+def _sleep(environ, start_response):
+    time.sleep(float(environ["QUERY_STRING"]))  # blocks event loop
+    start_response("200 OK", [("Content-Type", "text/plain")])
+    return [b"slept"]
+
 routes = {
     "/no_response": _no_response,
     "/invalid_return_type": _invalid_return_type,
+    "/file_wrapper": _file_wrapper,
+    "/stats": _stats,
+    "/latency": _latency,
+    "/sleep": _sleep,
+    "/cached_headers": _cached_headers,
+    "/fresh_headers": _fresh_headers,
+    "/varying_length": _varying_length,
+    "/environ": _environ,
 }
 
 
@@ -21,9 +21,15 @@ HOST = "127.0.0.1"
 PORT = 5000
 
 
+def run_server(application, host, port, options):
+    for name, value in options.items():
+        setattr(fastwsgi.server, name, value)
+    fastwsgi.run(application, host, port)
+
+
 class ServerProcess:
-    def __init__(self, application, host=HOST, port=PORT) -> None:
-        self.process = Process(target=fastwsgi.run, args=(application, host, port))
+    def __init__(self, application, host=HOST, port=PORT, options=None) -> None:
+        self.process = Process(target=run_server, args=(application, host, port, options or {}))
         self.endpoint = f"http://{host}:{port}"
         self.host = host
         self.port = port
@@ -42,6 +48,9 @@ class Servers(Enum):
     VALIDATOR_TEST_SERVER = 4
     START_RESPONSE_SERVER = 5
     GENERAL_TEST_APP = 6
+    LAZY_ENVIRON_APP = 7
+    OVERLOAD_APP = 8
+    TIMEOUT_APP = 9
 
 
 servers = {
@@ -51,6 +60,15 @@ servers = {
     Servers.VALIDATOR_TEST_SERVER: validator_app,
     Servers.START_RESPONSE_SERVER: start_response_app,
     Servers.GENERAL_TEST_APP: general_test_app,
+    Servers.LAZY_ENVIRON_APP: general_test_app,
+    Servers.OVERLOAD_APP: general_test_app,
+    Servers.TIMEOUT_APP: general_test_app,
+}
+
+server_options = {
+    Servers.LAZY_ENVIRON_APP: {"lazy_environ": 1},
+    Servers.OVERLOAD_APP: {"overload_lag": 100},
+    Servers.TIMEOUT_APP: {"keep_alive_timeout": 1, "header_timeout": 1},
 }
 
 
@@ -70,7 +88,7 @@ def pytest_sessionstart(session):
     for i, server in enumerate(servers.items()):
         with mute_ouput():
             name, app = server
-            server_process = ServerProcess(app, port=PORT + i)
+            server_process = ServerProcess(app, port=PORT + i, options=server_options.get(name))
             server_process.start()
         print(f"{name} is listening on port={PORT+i}")
         servers[name] = server_process
@@ -115,3 +133,32 @@ def start_response_server():
 @pytest.fixture
 def general_test_server():
     return servers.get(Servers.GENERAL_TEST_APP)
+
+
+@pytest.fixture
+def lazy_environ_server():
+    return servers.get(Servers.LAZY_ENVIRON_APP)
+
+
+@pytest.fixture
+def overload_test_server():
+    return servers.get(Servers.OVERLOAD_APP)
+
+
+@pytest.fixture
+def timeout_test_server():
+    return servers.get(Servers.TIMEOUT_APP)
+
+
+@pytest.fixture
+def sigterm_test_server(tmp_path):
+    # own process for every test: the server exits on SIGTERM
+    options = {"hook_sigterm": 1, "access_log": str(tmp_path / "access.log")}
+    with mute_ouput():
+        server_process = ServerProcess(general_test_app, port=PORT + len(servers), options=options)
+        server_process.start()
+    time.sleep(1)  # Allow server to start up
+    server_process.access_log = options["access_log"]
+    yield server_process
+    server_process.kill()
+    server_process.process.join()
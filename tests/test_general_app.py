@@ -1,3 +1,9 @@
+import os
+import json
+import time
+import socket
+import signal
+import pytest
 import requests
 
 
@@ -11,3 +17,179 @@ def test_invalid_return_type(general_test_server):
     url = f"{general_test_server.endpoint}/invalid_return_type"
     result = requests.get(url)
     assert result.status_code == 500
+
+def test_file_wrapper(general_test_server):
+    path = os.path.join(os.path.dirname(__file__), "apps_under_test", "general_test_app.py")
+    with open(path, "rb") as f:
+        expected = f.read()[10:]
+    url = f"{general_test_server.endpoint}/file_wrapper"
+    result = requests.get(url)
+    assert result.status_code == 200
+    assert result.headers["Content-Length"] == str(len(expected))
+    assert result.content == expected
+
+def test_stats(general_test_server):
+    url = f"{general_test_server.endpoint}/stats"
+    before = requests.get(url).json()
+    requests.get(f"{general_test_server.endpoint}/invalid_return_type")
+    after = requests.get(url).json()
+    assert after["servers"] == 1
+    assert after["requests"] == before["requests"] + 2
+    assert after["status_5xx"] == before["status_5xx"] + 1
+    assert after["conn_accepted"] >= before["conn_accepted"] + 2
+    assert after["bytes_in"] > before["bytes_in"]
+
+def test_header_cache(general_test_server):
+    url = f"{general_test_server.endpoint}/cached_headers"
+    first = requests.get(url)
+    second = requests.get(url)
+    for result in (first, second):
+        assert result.status_code == 200
+        assert result.headers["X-Cached"] == "yes"
+        assert result.headers["Content-Length"] == "6"
+        assert "Date" in result.headers
+        assert result.text == "cached"
+    stats = requests.get(f"{general_test_server.endpoint}/stats").json()
+    assert stats["header_cache_hits"] >= 1
+
+def test_header_cache_fresh_headers(general_test_server):
+    stats_url = f"{general_test_server.endpoint}/stats"
+    before = requests.get(stats_url).json()
+    for _ in range(4):
+        result = requests.get(f"{general_test_server.endpoint}/fresh_headers")
+        assert result.status_code == 200
+        assert result.headers["X-Fresh"] == "yes"
+        assert result.headers["Content-Type"] == "text/plain"
+        assert result.text == "fresh"
+    after = requests.get(stats_url).json()
+    assert after["header_cache_hits"] >= before["header_cache_hits"] + 2
+
+def test_header_cache_varying_length(general_test_server):
+    stats_url = f"{general_test_server.endpoint}/stats"
+    before = requests.get(stats_url).json()
+    for size in (1, 5, 12, 3, 7):
+        result = requests.get(f"{general_test_server.endpoint}/varying_length?{size}")
+        assert result.status_code == 200
+        assert result.headers["Content-Length"] == str(size)
+        assert result.content == b"x" * size
+    after = requests.get(stats_url).json()
+    assert after["header_cache_hits"] >= before["header_cache_hits"] + 3
+
+def recv_all(connection):
+    data = b""
+    while True:
+        chunk = connection.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    connection.close()
+    return data
+
+def test_pipeline_split_request(general_test_server):
+    requests.get(f"{general_test_server.endpoint}/latency?reset")
+    connection = socket.create_connection((general_test_server.host, general_test_server.port))
+    # response of first request is sended while second request is still arriving
+    connection.sendall(
+        b"GET /no_response HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        b"GET /no_response HTTP/1.1\r\nHost: localhost\r\n"
+    )
+    time.sleep(0.3)
+    connection.sendall(b"Connection: close\r\n\r\n")
+    data = recv_all(connection)
+    assert data.count(b"HTTP/1.1 200 OK\r\n") == 2
+    ttlb = requests.get(f"{general_test_server.endpoint}/latency").json()
+    assert ttlb["count"] == 3
+    assert ttlb["max"] >= 300000  # second request is measured until its own response
+
+@pytest.mark.parametrize("query", ["", "materialize"])
+def test_lazy_environ(lazy_environ_server, query):
+    request = (
+        f"GET /environ?{query} HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "X-Test: value\r\n"
+        "X-Pop: popped\r\n"
+        "X-Dup: first\r\n"
+        "X-Dup: last\r\n"
+        "X-Bad: \xff\xfe\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+    ).encode("latin-1")
+    connection = socket.create_connection((lazy_environ_server.host, lazy_environ_server.port))
+    connection.sendall(request)
+    data = recv_all(connection)
+    head, _, body = data.partition(b"\r\n\r\n")
+    assert head.startswith(b"HTTP/1.1 200")
+    result = json.loads(body)
+    assert result["type"] == "Environ"
+    assert result["get"] == "value"
+    assert result["get_default"] == "default"
+    assert result["contains"] is True
+    assert result["contains_missing"] is False
+    assert result["getitem"] == "value"
+    assert result["key_error"] is True
+    assert result["pop"] == "popped"
+    assert result["contains_popped"] is False
+    assert result["dup"] == "last"  # the last header with the same name wins
+    assert result["dict_dup"] == "last"
+    assert result["contains_bad"] is False  # value that is not valid UTF-8 is dropped
+    assert result["keys"] == ["HTTP_X_DUP", "HTTP_X_TEST"]
+    assert result["len"][0] == result["len"][1] == result["len"][2]
+
+def test_overload_recovers_after_idle(overload_test_server):
+    url = overload_test_server.endpoint
+    assert requests.get(f"{url}/sleep?2").status_code == 200
+    result = requests.get(f"{url}/no_response")
+    assert result.status_code == 503  # lag of blocked loop is above limit
+    assert result.headers["Retry-After"] == "1"
+    time.sleep(1.5)  # idle loop: lag decays
+    assert requests.get(f"{url}/no_response").status_code == 200
+
+def test_header_timeout_closes_silent_connection(timeout_test_server):
+    connection = socket.create_connection((timeout_test_server.host, timeout_test_server.port))
+    connection.settimeout(5)
+    start = time.time()
+    data = recv_all(connection)
+    assert data == b""  # peer has not sent a request: nothing to answer
+    assert time.time() - start >= 0.9
+
+def test_header_timeout_partial_request(timeout_test_server):
+    connection = socket.create_connection((timeout_test_server.host, timeout_test_server.port))
+    connection.settimeout(5)
+    connection.sendall(b"GET /no_response HTTP/1.1\r\nHost: local")
+    data = recv_all(connection)
+    assert data.startswith(b"HTTP/1.1 408")
+
+def test_keep_alive_timeout_closes_idle_connection(timeout_test_server):
+    connection = socket.create_connection((timeout_test_server.host, timeout_test_server.port))
+    connection.settimeout(5)
+    connection.sendall(b"GET /no_response HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    start = time.time()
+    data = recv_all(connection)
+    assert data.count(b"HTTP/1.1 200 OK\r\n") == 1
+    assert time.time() - start >= 0.9  # connection was kept alive until idle timeout
+
+def test_sigterm_drain_finishes_request(sigterm_test_server):
+    connection = socket.create_connection((sigterm_test_server.host, sigterm_test_server.port))
+    connection.settimeout(5)
+    connection.sendall(b"POST /no_response HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4\r\n\r\nab")
+    time.sleep(0.3)
+    os.kill(sigterm_test_server.process.pid, signal.SIGTERM)
+    time.sleep(0.3)
+    connection.sendall(b"cd")  # request started before SIGTERM is still served
+    data = recv_all(connection)
+    assert data.count(b"HTTP/1.1 200 OK\r\n") == 1
+    sigterm_test_server.process.join(10)
+    assert sigterm_test_server.process.exitcode == 0
+
+def test_access_log_written_on_shutdown(sigterm_test_server):
+    url = sigterm_test_server.endpoint
+    for path in ["/no_response", "/invalid_return_type", "/cached_headers"]:
+        requests.get(f"{url}{path}")
+    os.kill(sigterm_test_server.process.pid, signal.SIGTERM)
+    sigterm_test_server.process.join(10)
+    assert sigterm_test_server.process.exitcode == 0
+    with open(sigterm_test_server.access_log) as f:
+        lines = f.read().splitlines()
+    assert len(lines) == 3  # buffered records are written before exit
+    assert "/no_response" in lines[0] and " 200 " in lines[0]
+    assert "/invalid_return_type" in lines[1] and " 500 " in lines[1]